@@ -0,0 +1,45 @@
+#!/bin/bash
+# 测量启动恢复耗时: 生成N个对象 (默认1000万) 后启动服务并读取恢复报告
+# 用法: ./scripts/bench_startup.sh [对象数] [恢复线程数]
+
+BASE_DIR=$(cd "$(dirname "$0")/.." && pwd)
+cd $BASE_DIR
+
+COUNT=${1:-10000000}
+THREADS=${2:-0}
+BENCH_DIR=${BENCH_DIR:-/tmp/immutable_bench_data}
+BENCH_SOCK=/tmp/immutable_bench.sock
+
+echo "===== 启动恢复性能测试 ($COUNT 个对象) ====="
+
+if [ ! -f "$BENCH_DIR.count_$COUNT" ]; then
+    echo "生成测试对象到 $BENCH_DIR ..."
+    rm -rf "$BENCH_DIR" "$BENCH_DIR".count_*
+    mkdir -p "$BENCH_DIR"
+    (cd "$BENCH_DIR" && seq -f "obj%.0f" 1 "$COUNT" | xargs touch)
+    (cd "$BENCH_DIR" && seq -f "obj%.0f.meta" 1 "$COUNT" | xargs touch)
+    touch "$BENCH_DIR.count_$COUNT"
+fi
+
+# 清空页缓存可得到冷启动数据 (需要root权限)
+if [ "$COLD" = "1" ]; then
+    sync && echo 3 | sudo tee /proc/sys/vm/drop_caches > /dev/null
+fi
+
+: > "$BENCH_DIR/service.log"
+./immutable_service -d "$BENCH_DIR" -s "$BENCH_SOCK" -j "$THREADS" &
+SERVICE_PID=$!
+
+# 等待恢复完成
+while ! grep -q "启动恢复完成" "$BENCH_DIR/service.log" 2>/dev/null; do
+    if ! kill -0 $SERVICE_PID 2>/dev/null; then
+        echo "服务意外退出"
+        exit 1
+    fi
+    sleep 0.2
+done
+
+grep -E "服务就绪|启动恢复完成" "$BENCH_DIR/service.log"
+IMMUTABLE_SOCKET=$BENCH_SOCK ./immutable_client status
+
+kill $SERVICE_PID
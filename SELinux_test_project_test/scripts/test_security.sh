@@ -23,32 +23,47 @@ echo "尝试直接写入:" > data/test_security.txt
 cat data/test_security.txt
 echo
 
+# 完整性巡检 (须在下面的合法更新重新计算校验和之前进行)
+echo "3. 触发完整性巡检并查看报告 (应报告第2步直接写入的 test_security.txt 校验和不一致)..."
+./immutable_client scrub-start > /dev/null
+sleep 2
+report=$(./immutable_client scrub)
+echo "$report"
+if echo "$report" | grep -q "test_security.txt"; then
+    echo "巡检已发现绕过API的直接写入"
+else
+    echo "错误: 巡检报告中没有 test_security.txt"
+fi
+echo
+
 # 测试时间限制删除
-echo "3. 测试时间限制删除 (应该失败，因为未达到保留期)..."
+echo "4. 测试时间限制删除 (应该失败，因为未达到保留期)..."
 ./immutable_client delete test_security.txt
 echo
 
-# 测试错误的认证令牌
-echo "4. 测试错误的认证令牌 (需手动查看日志)..."
-# 这里我们使用错误的令牌发送请求
-# 由于我们不能修改客户端代码中的AUTH_TOKEN，所以只能提示
-echo "注意: 在实际应用中，使用错误的令牌的请求会被拒绝"
-echo "      您可以查看服务日志 (data/service.log) 了解更多信息"
+# 测试未授权的对端 (服务按连接的uid和SELinux域认证)
+echo "5. 测试未授权用户的请求 (应该返回认证失败)..."
+if [ "$(id -u)" -eq 0 ] && id nobody &> /dev/null; then
+    su nobody -s /bin/sh -c "./immutable_client info test_security.txt"
+else
+    echo "需要以root运行才能切换到nobody用户，跳过"
+fi
+echo "      会话的建立与拒绝记录在服务日志 (data/service.log) 中"
 echo
 
 # 测试增量更新
-echo "5. 测试增量更新功能..."
+echo "6. 测试增量更新功能..."
 ./immutable_client update test_security.txt "这是通过rsync增量更新的内容"
 echo
 
 # 显示文件信息
-echo "6. 显示文件信息..."
+echo "7. 显示文件信息..."
 ./immutable_client info test_security.txt
 echo
 
 # 模拟时间满足保留期
 if command -v touch &> /dev/null; then
-    echo "7. 模拟文件已达到保留期 (修改元数据文件时间)..."
+    echo "8. 模拟文件已达到保留期 (修改元数据文件时间)..."
     # 计算24小时前的时间戳
     if [[ "$OSTYPE" == "darwin"* ]]; then
         # macOS
@@ -6,13 +6,13 @@
 #include <sys/un.h>
 #include <time.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "immutable_client.h"
 
 #define SOCKET_PATH "/tmp/immutable_service.sock"
 #define MAX_PATH_LEN 1024
 #define MAX_RESPONSE_SIZE 4096
-#define AUTH_TOKEN "test_token_immutable_123"  // 需与服务端一致
 
 // 连接到服务
 static int connect_to_service() {
@@ -25,7 +25,9 @@ static int connect_to_service() {
     struct sockaddr_un addr;
     memset(&addr, 0, sizeof(addr));
     addr.sun_family = AF_UNIX;
-    strncpy(addr.sun_path, SOCKET_PATH, sizeof(addr.sun_path) - 1);
+    // 可通过环境变量指向其他实例 (例如备用实例)
+    const char *socket_path = getenv("IMMUTABLE_SOCKET");
+    strncpy(addr.sun_path, socket_path ? socket_path : SOCKET_PATH, sizeof(addr.sun_path) - 1);
     
     if (connect(sock_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
         perror("无法连接到服务");
@@ -36,64 +38,157 @@ static int connect_to_service() {
     return sock_fd;
 }
 
+// 与服务的连接, 在多次请求间复用; 服务端只在建立连接时认证一次
+// 多线程调用时由 service_lock 串行化, 请求与响应不会在连接上交错
+static int service_fd = -1;
+static pthread_mutex_t service_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void close_service(void) {
+    if (service_fd != -1) {
+        close(service_fd);
+        service_fd = -1;
+    }
+}
+
+void immutable_client_disconnect(void) {
+    pthread_mutex_lock(&service_lock);
+    close_service();
+    pthread_mutex_unlock(&service_lock);
+}
+
 // 准备请求头
 static void prepare_request(request_header *req, command_type cmd, const char *path, size_t data_len) {
     memset(req, 0, sizeof(request_header));
     req->cmd = cmd;
     strncpy(req->path, path, MAX_PATH_LEN - 1);
-    strncpy(req->token, AUTH_TOKEN, sizeof(req->token) - 1);
     req->data_len = data_len;
-    req->timestamp = time(NULL);
 }
 
-// 发送请求并接收响应
-static int send_request_receive_response(int sock_fd, request_header *req, 
-                                      const void *data, char *response, size_t response_size) {
+// 完整收发 (处理短读/短写)
+static int send_full(int sock_fd, const void *buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = send(sock_fd, (const char *)buf + done, len - done, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        done += n;
+    }
+    return 0;
+}
+
+static ssize_t recv_full(int sock_fd, void *buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = recv(sock_fd, (char *)buf + done, len - done, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return done;
+        done += n;
+    }
+    return done;
+}
+
+// 只读命令: 连接中断时无论服务端是否已处理, 重发都不会改变数据
+static int command_idempotent(command_type cmd) {
+    return cmd == CMD_GET_INFO || cmd == CMD_LIST || cmd == CMD_REPL_STATUS || cmd == CMD_SCRUB_REPORT;
+}
+
+// 在当前连接上发送请求并接收响应, 返回响应长度
+// *stale 表示请求可以安全重发: 请求头未能发出 (连接已被服务端关闭), 或只读命令未收到响应
+// *closing 表示响应后连接不可再用
+static int exchange(request_header *req, const void *data, char *response,
+                    size_t response_size, int *status, int *stale, int *closing) {
+    response_header resp;
+    ssize_t n;
+    
+    *stale = 0;
+    *closing = 0;
+    
     // 发送请求头
-    if (send(sock_fd, req, sizeof(request_header), 0) != sizeof(request_header)) {
-        perror("发送请求失败");
+    if (send_full(service_fd, req, sizeof(request_header)) != 0) {
+        *stale = 1;
         return -1;
     }
     
-    // 发送数据(如果有)
-    if (data && req->data_len > 0) {
-        if (send(sock_fd, data, req->data_len, 0) != req->data_len) {
-            perror("发送数据失败");
-            return -1;
-        }
+    // 发送数据(如果有); 服务端拒绝请求时会先回复原因再关闭连接, 因此失败时仍读取响应
+    if (data && req->data_len > 0 && send_full(service_fd, data, req->data_len) != 0) {
+        *closing = 1;
     }
     
-    // 接收响应
-    ssize_t recv_len = recv(sock_fd, response, response_size - 1, 0);
-    if (recv_len <= 0) {
-        perror("接收响应失败");
+    // 接收响应头
+    // 服务端可能已执行请求后才断开, 变更命令 (尤其是追加和区段写入) 重发会重复应用
+    n = recv_full(service_fd, &resp, sizeof(resp));
+    if (n != sizeof(resp)) {
+        *stale = n == 0 && !*closing && command_idempotent(req->cmd);
         return -1;
     }
     
-    response[recv_len] = '\0';
-    return recv_len;
+    // 接收响应内容, 超出缓冲区的部分丢弃
+    size_t keep = resp.length < response_size - 1 ? resp.length : response_size - 1;
+    if (recv_full(service_fd, response, keep) != (ssize_t)keep) {
+        return -1;
+    }
+    for (size_t left = resp.length - keep; left > 0; ) {
+        char discard[256];
+        size_t chunk = left < sizeof(discard) ? left : sizeof(discard);
+        if (recv_full(service_fd, discard, chunk) != (ssize_t)chunk) return -1;
+        left -= chunk;
+    }
+    
+    response[keep] = '\0';
+    *status = resp.status;
+    return keep;
 }
 
-// 修改不可变文件
-int modify_immutable_file(const char *path, const char *data, size_t data_len) {
-    int sock_fd = connect_to_service();
-    if (sock_fd == -1) {
-        return -1;
+// 发送请求并接收响应 (持有 service_lock)
+static int send_request_receive_response(request_header *req, const void *data,
+                                         char *response, size_t response_size, int *status) {
+    int reused;
+    int stale, closing;
+    int result = -1;
+    
+    pthread_mutex_lock(&service_lock);
+    reused = service_fd != -1;
+    if (!reused) {
+        service_fd = connect_to_service();
+        if (service_fd == -1) goto out;
+    }
+    
+    result = exchange(req, data, response, response_size, status, &stale, &closing);
+    
+    // 复用的连接可能已被服务端关闭 (服务重启等), 请求未被处理或可安全重发, 重新连接后重试一次
+    if (result < 0 && reused && stale) {
+        close_service();
+        service_fd = connect_to_service();
+        if (service_fd == -1) goto out;
+        result = exchange(req, data, response, response_size, status, &stale, &closing);
     }
     
+    if (result < 0) {
+        perror("接收响应失败");
+    }
+    if (result < 0 || closing) {
+        close_service();
+    }
+    
+out:
+    pthread_mutex_unlock(&service_lock);
+    return result;
+}
+
+// 修改不可变文件
+int modify_immutable_file(const char *path, const char *data, size_t data_len) {
     // 准备请求
     request_header req;
     prepare_request(&req, CMD_MODIFY, path, data_len);
     
     // 发送请求并接收响应
     char response[MAX_RESPONSE_SIZE];
-    int result = send_request_receive_response(sock_fd, &req, data, response, sizeof(response));
+    int status = -1;
+    int result = send_request_receive_response(&req, data, response, sizeof(response), &status);
     
-    close(sock_fd);
-    
-    if (result > 0) {
+    if (result >= 0) {
         printf("服务响应: %s\n", response);
-        return strstr(response, "成功") ? 0 : -1;
+        return status == 0 ? 0 : -1;
     }
     
     return -1;
@@ -101,24 +196,18 @@ int modify_immutable_file(const char *path, const char *data, size_t data_len) {
 
 // 删除不可变文件
 int delete_immutable_file(const char *path) {
-    int sock_fd = connect_to_service();
-    if (sock_fd == -1) {
-        return -1;
-    }
-    
     // 准备请求
     request_header req;
     prepare_request(&req, CMD_DELETE, path, 0);
     
     // 发送请求并接收响应
     char response[MAX_RESPONSE_SIZE];
-    int result = send_request_receive_response(sock_fd, &req, NULL, response, sizeof(response));
-    
-    close(sock_fd);
+    int status = -1;
+    int result = send_request_receive_response(&req, NULL, response, sizeof(response), &status);
     
-    if (result > 0) {
+    if (result >= 0) {
         printf("服务响应: %s\n", response);
-        return strstr(response, "成功") ? 0 : -1;
+        return status == 0 ? 0 : -1;
     }
     
     return -1;
@@ -126,24 +215,78 @@ int delete_immutable_file(const char *path) {
 
 // 增量更新文件
 int rsync_update_immutable_file(const char *path, const char *data, size_t data_len) {
-    int sock_fd = connect_to_service();
-    if (sock_fd == -1) {
+    // 准备请求
+    request_header req;
+    prepare_request(&req, CMD_RSYNC_UPDATE, path, data_len);
+    
+    // 发送请求并接收响应
+    char response[MAX_RESPONSE_SIZE];
+    int status = -1;
+    int result = send_request_receive_response(&req, data, response, sizeof(response), &status);
+    
+    if (result >= 0) {
+        printf("服务响应: %s\n", response);
+        return status == 0 ? 0 : -1;
+    }
+    
+    return -1;
+}
+
+// 追加内容
+int append_immutable_file(const char *path, const char *data, size_t data_len) {
+    // 准备请求
+    request_header req;
+    prepare_request(&req, CMD_APPEND, path, data_len);
+    
+    // 发送请求并接收响应
+    char response[MAX_RESPONSE_SIZE];
+    int status = -1;
+    int result = send_request_receive_response(&req, data, response, sizeof(response), &status);
+    
+    if (result >= 0) {
+        printf("服务响应: %s\n", response);
+        return status == 0 ? 0 : -1;
+    }
+    
+    return -1;
+}
+
+// 按偏移写入区段
+int patch_immutable_file(const char *path, const patch_extent *extents,
+                         const char *const *data, size_t count) {
+    size_t payload_len = 0;
+    char *payload, *p;
+    
+    // 组装区段列表: 区段头 + 数据
+    for (size_t i = 0; i < count; i++) {
+        payload_len += sizeof(patch_extent) + extents[i].length;
+    }
+    payload = malloc(payload_len ? payload_len : 1);
+    if (!payload) {
         return -1;
     }
+    p = payload;
+    for (size_t i = 0; i < count; i++) {
+        memcpy(p, &extents[i], sizeof(patch_extent));
+        p += sizeof(patch_extent);
+        memcpy(p, data[i], extents[i].length);
+        p += extents[i].length;
+    }
     
     // 准备请求
     request_header req;
-    prepare_request(&req, CMD_RSYNC_UPDATE, path, data_len);
+    prepare_request(&req, CMD_PATCH, path, payload_len);
     
     // 发送请求并接收响应
     char response[MAX_RESPONSE_SIZE];
-    int result = send_request_receive_response(sock_fd, &req, data, response, sizeof(response));
+    int status = -1;
+    int result = send_request_receive_response(&req, payload, response, sizeof(response), &status);
     
-    close(sock_fd);
+    free(payload);
     
-    if (result > 0) {
+    if (result >= 0) {
         printf("服务响应: %s\n", response);
-        return strstr(response, "成功") ? 0 : -1;
+        return status == 0 ? 0 : -1;
     }
     
     return -1;
@@ -151,11 +294,6 @@ int rsync_update_immutable_file(const char *path, const char *data, size_t data_
 
 // 获取文件信息
 char* get_immutable_file_info(const char *path) {
-    int sock_fd = connect_to_service();
-    if (sock_fd == -1) {
-        return NULL;
-    }
-    
     // 准备请求
     request_header req;
     prepare_request(&req, CMD_GET_INFO, path, 0);
@@ -163,14 +301,12 @@ char* get_immutable_file_info(const char *path) {
     // 分配响应缓冲区
     char *info = malloc(MAX_RESPONSE_SIZE);
     if (!info) {
-        close(sock_fd);
         return NULL;
     }
     
     // 发送请求并接收响应
-    int result = send_request_receive_response(sock_fd, &req, NULL, info, MAX_RESPONSE_SIZE);
-    
-    close(sock_fd);
+    int status = -1;
+    int result = send_request_receive_response(&req, NULL, info, MAX_RESPONSE_SIZE, &status);
     
     if (result > 0) {
         return info;
@@ -180,6 +316,214 @@ char* get_immutable_file_info(const char *path) {
     return NULL;
 }
 
+// 获取复制状态
+char* get_replication_status(void) {
+    // 准备请求
+    request_header req;
+    prepare_request(&req, CMD_REPL_STATUS, "", 0);
+    
+    // 分配响应缓冲区
+    char *repl_status = malloc(MAX_RESPONSE_SIZE);
+    if (!repl_status) {
+        return NULL;
+    }
+    
+    // 发送请求并接收响应
+    int status = -1;
+    int result = send_request_receive_response(&req, NULL, repl_status, MAX_RESPONSE_SIZE, &status);
+    
+    if (result > 0) {
+        return repl_status;
+    }
+    
+    free(repl_status);
+    return NULL;
+}
+
+// 提升备用实例
+int promote_standby(void) {
+    // 准备请求
+    request_header req;
+    prepare_request(&req, CMD_PROMOTE, "", 0);
+    
+    // 发送请求并接收响应
+    char response[MAX_RESPONSE_SIZE];
+    int status = -1;
+    int result = send_request_receive_response(&req, NULL, response, sizeof(response), &status);
+    
+    if (result >= 0) {
+        printf("服务响应: %s\n", response);
+        return status == 0 ? 0 : -1;
+    }
+    
+    return -1;
+}
+
+// 获取完整性巡检报告
+char* get_scrub_report(int start) {
+    // 准备请求
+    request_header req;
+    prepare_request(&req, start ? CMD_SCRUB_START : CMD_SCRUB_REPORT, "", 0);
+    
+    // 分配响应缓冲区
+    char *report = malloc(MAX_RESPONSE_SIZE);
+    if (!report) {
+        return NULL;
+    }
+    
+    // 发送请求并接收响应
+    int status = -1;
+    int result = send_request_receive_response(&req, NULL, report, MAX_RESPONSE_SIZE, &status);
+    
+    if (result > 0) {
+        return report;
+    }
+    
+    free(report);
+    return NULL;
+}
+
+int list_immutable_files(const char *prefix, char *cursor, unsigned limit, int with_metadata,
+                         list_entry **entries, size_t *count) {
+    // 准备请求
+    request_header req;
+    list_request lr;
+    prepare_request(&req, CMD_LIST, prefix, sizeof(lr));
+    memset(&lr, 0, sizeof(lr));
+    if (limit == 0) limit = LIST_DEFAULT_LIMIT;
+    if (limit > LIST_MAX_LIMIT) limit = LIST_MAX_LIMIT;
+    lr.limit = limit;
+    lr.flags = with_metadata ? LIST_WITH_METADATA : 0;
+    strncpy(lr.cursor, cursor, MAX_PATH_LEN - 1);
+    
+    *entries = NULL;
+    *count = 0;
+    
+    // 按最大可能的响应分配缓冲区
+    size_t entry_size = sizeof(uint16_t) + MAX_PATH_LEN + (with_metadata ? sizeof(list_record) : 0);
+    size_t response_size = sizeof(list_response) + MAX_PATH_LEN + limit * entry_size + 1;
+    char *response = malloc(response_size);
+    if (!response) {
+        return -1;
+    }
+    
+    // 发送请求并接收响应
+    int status = -1;
+    int result = send_request_receive_response(&req, &lr, response, response_size, &status);
+    if (result < 0 || status != 0 || (size_t)result < sizeof(list_response)) {
+        if (result > 0) fprintf(stderr, "列举失败: %s\n", response);
+        free(response);
+        return -1;
+    }
+    
+    list_response resp;
+    const char *p = response + sizeof(resp);
+    const char *end = response + result;
+    memcpy(&resp, response, sizeof(resp));
+    
+    list_entry *list = calloc(resp.count ? resp.count : 1, sizeof(list_entry));
+    if (!list || resp.cursor_len >= MAX_PATH_LEN || p + resp.cursor_len > end) {
+        free(list);
+        free(response);
+        return -1;
+    }
+    memcpy(cursor, p, resp.cursor_len);
+    cursor[resp.cursor_len] = '\0';
+    p += resp.cursor_len;
+    
+    // 解析各条结果
+    size_t n = 0;
+    for (; n < resp.count; n++) {
+        uint16_t path_len;
+        if (p + sizeof(path_len) > end) break;
+        memcpy(&path_len, p, sizeof(path_len));
+        p += sizeof(path_len);
+        if (p + path_len + (with_metadata ? sizeof(list_record) : 0) > end) break;
+        list[n].path = strndup(p, path_len);
+        if (!list[n].path) break;
+        p += path_len;
+        if (with_metadata) {
+            memcpy(&list[n].record, p, sizeof(list_record));
+            p += sizeof(list_record);
+        }
+    }
+    free(response);
+    
+    if (n < resp.count) {
+        free_list_entries(list, n);
+        return -1;
+    }
+    *entries = list;
+    *count = n;
+    return resp.more ? 1 : 0;
+}
+
+void free_list_entries(list_entry *entries, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        free(entries[i].path);
+    }
+    free(entries);
+}
+
+int watch_immutable_files(const char *prefix, uint64_t *epoch, uint64_t *last_seq,
+                          watch_callback callback, void *arg) {
+    // 订阅占用整个连接, 不使用复用的连接
+    int sock_fd = connect_to_service();
+    if (sock_fd == -1) {
+        return -1;
+    }
+    
+    // 准备并发送请求
+    request_header req;
+    watch_request wr;
+    prepare_request(&req, CMD_WATCH, prefix, sizeof(wr));
+    wr.epoch = *epoch;
+    wr.since_seq = *last_seq;
+    
+    response_header resp;
+    watch_ack ack;
+    if (send_full(sock_fd, &req, sizeof(req)) != 0 || send_full(sock_fd, &wr, sizeof(wr)) != 0 ||
+        recv_full(sock_fd, &resp, sizeof(resp)) != sizeof(resp)) {
+        perror("订阅失败");
+        close(sock_fd);
+        return -1;
+    }
+    if (resp.status != 0 || resp.length != sizeof(ack)) {
+        char reason[256] = {0};
+        size_t keep = resp.length < sizeof(reason) - 1 ? resp.length : sizeof(reason) - 1;
+        recv_full(sock_fd, reason, keep);
+        fprintf(stderr, "订阅被拒绝: %s\n", reason);
+        close(sock_fd);
+        return resp.status == WATCH_REJECT_BUSY || resp.status == WATCH_REJECT_INVALID_SEQ ?
+               resp.status : -1;
+    }
+    if (recv_full(sock_fd, &ack, sizeof(ack)) != sizeof(ack)) {
+        close(sock_fd);
+        return -1;
+    }
+    *epoch = ack.epoch;
+    *last_seq = ack.next_seq - 1;
+    
+    // 逐个接收事件
+    for (;;) {
+        watch_event ev;
+        char path[MAX_PATH_LEN];
+        
+        if (recv_full(sock_fd, &ev, sizeof(ev)) != sizeof(ev) || ev.path_len >= MAX_PATH_LEN ||
+            recv_full(sock_fd, path, ev.path_len) != (ssize_t)ev.path_len) {
+            close(sock_fd);
+            return -1;
+        }
+        path[ev.path_len] = '\0';
+        *last_seq = ev.seq;
+        
+        if (callback(&ev, path, arg) != 0) {
+            close(sock_fd);
+            return 0;
+        }
+    }
+}
+
 // 主程序(用于命令行测试)
 #ifdef CLIENT_MAIN
 void print_usage(const char *prog_name) {
@@ -188,13 +532,121 @@ void print_usage(const char *prog_name) {
     printf("  modify    - 修改文件\n");
     printf("  delete    - 删除文件\n");
     printf("  update    - 增量更新文件\n");
+    printf("  append    - 在文件末尾追加内容\n");
+    printf("  patch     - 从指定偏移处写入内容 (参数: <文件路径> <偏移> <内容>)\n");
     printf("  info      - 获取文件信息\n");
+    printf("  status    - 获取复制状态 (无需文件路径)\n");
+    printf("  promote   - 将备用实例提升为主实例 (无需文件路径)\n");
+    printf("  scrub     - 获取完整性巡检报告 (无需文件路径)\n");
+    printf("  scrub-start - 立即开始新一轮完整性巡检 (无需文件路径)\n");
+    printf("  list      - 列举对象及其大小、修改时间、保留状态和校验和 (参数: [前缀])\n");
+    printf("  watch     - 持续输出前缀下的变更事件, 断线后自动续订 (参数: [前缀])\n");
     printf("示例:\n");
     printf("  %s modify test.txt \"这是测试内容\"\n", prog_name);
     printf("  %s delete test.txt\n", prog_name);
+    printf("  %s append audit.log \"新的一行\"\n", prog_name);
+    printf("  %s patch audit.log 0 \"覆盖开头\"\n", prog_name);
+    printf("  %s list logs/\n", prog_name);
+    printf("  %s watch logs/\n", prog_name);
+    printf("  IMMUTABLE_SOCKET=/tmp/immutable_standby.sock %s status\n", prog_name);
+}
+
+static int print_event(const watch_event *event, const char *path, void *arg) {
+    static const char *names[] = { "", "新建", "修改", "增量更新", "区段写入", "删除",
+                                   "保留期已满", "带外写入", "事件丢失" };
+    char when[32];
+    time_t t = (time_t)event->time;
+    
+    (void)arg;
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&t));
+    printf("[%llu] %s  %-8s %s\n", (unsigned long long)event->seq, when,
+           event->type < sizeof(names) / sizeof(names[0]) ? names[event->type] : "未知",
+           event->type == WATCH_EVENT_LOST ? "(请用 list 重新同步)" : path);
+    fflush(stdout);
+    return 0;
 }
 
 int main(int argc, char *argv[]) {
+    if (argc == 2 && strcmp(argv[1], "status") == 0) {
+        char *status = get_replication_status();
+        if (!status) {
+            printf("获取复制状态失败\n");
+            return 1;
+        }
+        printf("%s\n", status);
+        free(status);
+        return 0;
+    }
+    
+    if (argc == 2 && strcmp(argv[1], "promote") == 0) {
+        return promote_standby() == 0 ? 0 : 1;
+    }
+    
+    if (argc == 2 && (strcmp(argv[1], "scrub") == 0 || strcmp(argv[1], "scrub-start") == 0)) {
+        char *report = get_scrub_report(strcmp(argv[1], "scrub-start") == 0);
+        if (!report) {
+            printf("获取巡检报告失败\n");
+            return 1;
+        }
+        printf("%s\n", report);
+        free(report);
+        return 0;
+    }
+    
+    if ((argc == 2 || argc == 3) && strcmp(argv[1], "list") == 0) {
+        char cursor[MAX_PATH_LEN] = "";
+        int more;
+        
+        // 逐页获取, 直到服务端表示没有后续页
+        do {
+            list_entry *entries;
+            size_t count;
+            more = list_immutable_files(argc == 3 ? argv[2] : "", cursor, 0, 1, &entries, &count);
+            if (more < 0) {
+                printf("列举对象失败\n");
+                return 1;
+            }
+            for (size_t i = 0; i < count; i++) {
+                char mtime[32];
+                time_t modified = (time_t)entries[i].record.modification_time;
+                strftime(mtime, sizeof(mtime), "%Y-%m-%d %H:%M:%S", localtime(&modified));
+                printf("%-40s %12llu  %s  %s  %s\n", entries[i].path,
+                       (unsigned long long)entries[i].record.size, mtime,
+                       entries[i].record.retention_expired ? "可删除" : "保留中",
+                       entries[i].record.checksum);
+            }
+            free_list_entries(entries, count);
+        } while (more > 0);
+        return 0;
+    }
+    
+    if ((argc == 2 || argc == 3) && strcmp(argv[1], "watch") == 0) {
+        uint64_t epoch = 0, last_seq = 0;
+        
+        // 连接断开后从最后收到的序号续订
+        for (;;) {
+            int result = watch_immutable_files(argc == 3 ? argv[2] : "", &epoch, &last_seq,
+                                               print_event, NULL);
+            if (result == 0) {
+                return 0;
+            }
+            unsigned int delay = 1;
+            if (result == WATCH_REJECT_INVALID_SEQ) {
+                // 续订的序号不被承认, 重新开始订阅, 期间的变更需通过 list 补齐
+                epoch = 0;
+                last_seq = 0;
+                printf("序号无效, 需通过 list 重新同步, 1秒后重新订阅\n");
+            } else if (result == WATCH_REJECT_BUSY) {
+                delay = 5;
+                printf("订阅者过多, 5秒后从序号 %llu 重试\n", (unsigned long long)last_seq);
+            } else {
+                printf("连接断开, 1秒后从序号 %llu 续订\n", (unsigned long long)last_seq);
+            }
+            fflush(stdout);
+            sleep(delay);
+        }
+    }
+    
     if (argc < 3) {
         print_usage(argv[0]);
         return 1;
@@ -223,6 +675,30 @@ int main(int argc, char *argv[]) {
         const char *content = argv[3];
         result = rsync_update_immutable_file(path, content, strlen(content));
     } 
+    else if (strcmp(cmd, "append") == 0) {
+        if (argc < 4) {
+            printf("错误: append命令需要提供追加的内容\n");
+            return 1;
+        }
+        const char *content = argv[3];
+        result = append_immutable_file(path, content, strlen(content));
+    } 
+    else if (strcmp(cmd, "patch") == 0) {
+        if (argc < 5) {
+            printf("错误: patch命令需要提供偏移和内容\n");
+            return 1;
+        }
+        char *end;
+        patch_extent extent;
+        const char *content = argv[4];
+        extent.offset = strtoull(argv[3], &end, 10);
+        if (*end != '\0') {
+            printf("错误: 无效的偏移: %s\n", argv[3]);
+            return 1;
+        }
+        extent.length = strlen(content);
+        result = patch_immutable_file(path, &extent, &content, 1);
+    } 
     else if (strcmp(cmd, "info") == 0) {
         char *info = get_immutable_file_info(path);
         if (info) {
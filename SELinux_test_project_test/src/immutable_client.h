@@ -2,6 +2,7 @@
 #define IMMUTABLE_CLIENT_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <time.h>
 
 // 命令类型
@@ -9,18 +10,100 @@ typedef enum {
     CMD_MODIFY = 1,        // 修改文件
     CMD_DELETE = 2,        // 删除文件
     CMD_RSYNC_UPDATE = 3,  // 增量更新
-    CMD_GET_INFO = 4       // 获取文件信息
+    CMD_GET_INFO = 4,      // 获取文件信息
+    CMD_REPLICATE = 5,     // 日志复制 (仅供服务实例之间使用)
+    CMD_REPL_STATUS = 6,   // 获取复制状态
+    CMD_PROMOTE = 7,       // 将备用实例提升为主实例
+    CMD_SCRUB_REPORT = 8,  // 获取完整性巡检报告
+    CMD_SCRUB_START = 9,   // 立即开始新一轮完整性巡检
+    CMD_APPEND = 10,       // 在文件末尾追加
+    CMD_PATCH = 11,        // 按偏移写入若干区段
+    CMD_LIST = 12,         // 按前缀分页列举对象
+    CMD_WATCH = 13         // 订阅前缀下的变更事件 (连接此后只用于推送事件)
 } command_type;
 
-// 请求头结构体
+// 请求头结构体 (服务端按连接的对端凭据认证, 请求不携带令牌)
 typedef struct {
     command_type cmd;
     char path[1024];
-    char token[128];
     size_t data_len;
-    time_t timestamp;
 } request_header;
 
+// CMD_PATCH 的区段头, 其后紧跟 length 字节数据
+typedef struct {
+    uint64_t offset;
+    uint64_t length;
+} patch_extent;
+
+// CMD_LIST 的请求数据; 请求头中的路径为前缀 (可为空)
+#define LIST_WITH_METADATA 0x1     // 每条结果附带 list_record
+#define LIST_DEFAULT_LIMIT 256
+#define LIST_MAX_LIMIT 4096
+typedef struct {
+    uint32_t limit;                // 每页最多条目数, 0 表示默认值
+    uint32_t flags;
+    char cursor[1024];             // 上一页返回的游标, 空表示从头开始
+} list_request;
+
+// CMD_LIST 的响应: list_response 和下一页游标 (无结尾0), 随后 count 条结果;
+// 每条为 uint16_t 路径长度 + 路径 (无结尾0), 请求元数据时再跟一个 list_record
+typedef struct {
+    uint32_t count;
+    uint16_t more;                 // 非0表示还有后续页
+    uint16_t cursor_len;
+} list_response;
+
+typedef struct {
+    uint64_t size;
+    int64_t creation_time;
+    int64_t modification_time;
+    uint32_t retention_expired;
+    char checksum[72];
+} list_record;
+
+// CMD_WATCH 的请求数据; 请求头中的路径为前缀 (可为空)
+typedef struct {
+    uint64_t epoch;                // 上次订阅得到的纪元, 0 表示新订阅
+    uint64_t since_seq;            // 已收到的最后一个事件序号 (新订阅时忽略, 只接收新事件)
+} watch_request;
+
+// 订阅成功时的响应内容; 之后服务端在该连接上持续推送 watch_event
+typedef struct {
+    uint64_t epoch;                // 服务实例的纪元, 重启后改变, 序号只在同一纪元内有效
+    uint64_t next_seq;             // 下一个将推送的事件序号
+} watch_ack;
+
+// CMD_WATCH 被拒绝时的响应状态, 响应内容为原因文本
+typedef enum {
+    WATCH_REJECT_BUSY = -2,        // 订阅者过多, 稍后以相同参数重试
+    WATCH_REJECT_INVALID_SEQ = -3  // 序号超出当前纪元已分配的范围, 应以纪元0重新订阅并通过 list 同步
+} watch_reject;
+
+typedef enum {
+    WATCH_EVENT_CREATED = 1,           // 新建对象
+    WATCH_EVENT_MODIFIED = 2,          // 整体修改
+    WATCH_EVENT_UPDATED = 3,           // 增量更新
+    WATCH_EVENT_PATCHED = 4,           // 追加或区段写入
+    WATCH_EVENT_DELETED = 5,
+    WATCH_EVENT_RETENTION_EXPIRED = 6, // 已满足最小保留期, 可以删除
+    WATCH_EVENT_EXTERNAL_WRITE = 7,    // 绕过服务对数据目录的写入 (需启用 fanotify)
+    WATCH_EVENT_LOST = 8               // 序号不超过 seq 的事件已丢失, 需用 CMD_LIST 重新同步
+} watch_event_type;
+
+// 推送的事件: watch_event 后紧跟 path_len 字节路径 (无结尾0)
+typedef struct {
+    uint64_t seq;
+    int64_t time;
+    uint32_t type;
+    uint32_t path_len;
+} watch_event;
+
+// 响应头结构体, 其后为 length 字节的响应内容
+typedef struct {
+    int status;
+    size_t length;
+} response_header;
+
 /**
  * 修改不可变文件
  * 
@@ -49,6 +132,28 @@ int delete_immutable_file(const char *path);
  */
 int rsync_update_immutable_file(const char *path, const char *data, size_t data_len);
 
+/**
+ * 在文件末尾追加内容 (文件不存在时创建)
+ * 
+ * @param path 文件路径 (相对于数据目录)
+ * @param data 追加的内容
+ * @param data_len 内容长度
+ * @return 成功返回0，失败返回-1
+ */
+int append_immutable_file(const char *path, const char *data, size_t data_len);
+
+/**
+ * 按偏移写入若干区段, 只传输和重新校验修改的部分
+ * 
+ * @param path 文件路径 (相对于数据目录)
+ * @param extents 区段的偏移和长度 (偏移不能超过此前的文件末尾)
+ * @param data 各区段的内容
+ * @param count 区段数
+ * @return 成功返回0，失败返回-1
+ */
+int patch_immutable_file(const char *path, const patch_extent *extents,
+                         const char *const *data, size_t count);
+
 /**
  * 获取文件信息
  * 
@@ -57,4 +162,71 @@ int rsync_update_immutable_file(const char *path, const char *data, size_t data_
  */
 char* get_immutable_file_info(const char *path);
 
+/**
+ * 获取服务实例的复制状态 (角色、序号与复制延迟)
+ * 
+ * @return 成功返回状态字符串，失败返回NULL (注意：调用者负责释放返回的内存)
+ */
+char* get_replication_status(void);
+
+/**
+ * 将备用实例提升为主实例
+ * 
+ * @return 成功返回0，失败返回-1
+ */
+int promote_standby(void);
+
+/**
+ * 获取完整性巡检报告 (进度与校验和不一致的对象)
+ * 
+ * @param start 非0时先请求立即开始新一轮巡检
+ * @return 成功返回报告字符串，失败返回NULL (注意：调用者负责释放返回的内存)
+ */
+char* get_scrub_report(int start);
+
+// list_immutable_files 返回的一条结果
+typedef struct {
+    char *path;
+    list_record record;            // 仅在请求元数据时有效
+} list_entry;
+
+/**
+ * 按前缀分页列举对象 (按路径排序)
+ * 
+ * @param prefix 路径前缀 (相对于数据目录), 空字符串表示全部
+ * @param cursor 输入为上一页的游标 (首页为空字符串), 返回时更新为下一页的游标 (缓冲区至少1024字节)
+ * @param limit 每页最多条目数, 0 表示默认值
+ * @param with_metadata 非0时每条结果附带大小、时间、保留状态和校验和
+ * @param entries 返回结果数组 (调用者用 free_list_entries 释放)
+ * @param count 返回结果数
+ * @return 还有后续页返回1，已到末尾返回0，失败返回-1
+ */
+int list_immutable_files(const char *prefix, char *cursor, unsigned limit, int with_metadata,
+                         list_entry **entries, size_t *count);
+
+void free_list_entries(list_entry *entries, size_t count);
+
+// 收到一个事件时调用, 返回非0结束订阅
+typedef int (*watch_callback)(const watch_event *event, const char *path, void *arg);
+
+/**
+ * 订阅前缀下的变更事件, 在单独的连接上阻塞接收, 直到回调返回非0或连接断开
+ * 
+ * @param prefix 路径前缀 (相对于数据目录), 空字符串表示全部
+ * @param epoch 输入为上次订阅的纪元 (新订阅为0), 返回时更新为服务的当前纪元
+ * @param last_seq 输入为已收到的最后一个事件序号 (新订阅时忽略), 接收过程中持续更新;
+ *                 断线后原样传回即可续订, 期间的事件已不可得时先收到 WATCH_EVENT_LOST
+ * @param callback 事件回调
+ * @return 回调结束订阅返回0，被拒绝返回 WATCH_REJECT_BUSY (可原样重试) 或
+ *         WATCH_REJECT_INVALID_SEQ (应以纪元0重新订阅)，连接失败或断开返回-1
+ */
+int watch_immutable_files(const char *prefix, uint64_t *epoch, uint64_t *last_seq,
+                          watch_callback callback, void *arg);
+
+/**
+ * 关闭与服务的连接 (各函数复用同一连接, 需要时自动重新连接)
+ * 各函数可在多个线程中调用, 共用的连接上请求依次进行; 需要并发请求时使用多个进程
+ */
+void immutable_client_disconnect(void);
+
 #endif /* IMMUTABLE_CLIENT_H */ 
\ No newline at end of file
@@ -2,74 +2,65 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/uio.h>
+#include <limits.h>
 #include <time.h>
 #include <errno.h>
 #include <signal.h>
 #include <syslog.h>
+#include <pthread.h>
 #include <selinux/selinux.h>
 #include <selinux/context.h>
 
-// 配置
-#define SOCKET_PATH "/tmp/immutable_service.sock"
-#define DATA_DIR "/Users/amireuxjoe/SELinux/SELinux_test_project_test/data"
-#define LOG_FILE "/Users/amireuxjoe/SELinux/SELinux_test_project_test/data/service.log"
-#define MAX_PATH_LEN 1024
-#define MAX_DATA_SIZE (10 * 1024 * 1024) // 10MB
-#define AUTH_TOKEN "test_token_immutable_123"  // 实际应用中应更安全
-#define MIN_RETENTION_HOURS 24  // 文件保留最少24小时
-
-// 命令类型
-typedef enum {
-    CMD_MODIFY = 1,        // 修改文件
-    CMD_DELETE = 2,        // 删除文件
-    CMD_RSYNC_UPDATE = 3,  // 增量更新
-    CMD_GET_INFO = 4       // 获取文件信息
-} command_type;
-
-// 请求头
-typedef struct {
-    command_type cmd;
-    char path[MAX_PATH_LEN];
-    char token[128];
-    size_t data_len;
-    time_t timestamp;
-} request_header;
-
-// 文件元数据
-typedef struct {
-    time_t creation_time;
-    time_t modification_time;
-    char checksum[64];
-} file_metadata;
+#include "immutable_service.h"
+#include "journal.h"
+#include "object_index.h"
+#include "recovery.h"
+#include "scrubber.h"
+#include "sha256.h"
+#include "scheduler.h"
+#include "session.h"
+#include "merkle.h"
+#include "watch.h"
 
 // 全局变量
 int server_fd = -1;
+static int epoll_fd = -1;
+static int signal_fd = -1;
 FILE *log_fp = NULL;
+const char *data_dir = DATA_DIR;
+const char *socket_path = SOCKET_PATH;
 
 // 日志函数
 void log_message(const char *level, const char *message, ...) {
     time_t now;
-    struct tm *tm_info;
+    struct tm tm_info;
     char timestamp[64];
     va_list args;
     
     time(&now);
-    tm_info = localtime(&now);
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", tm_info);
+    localtime_r(&now, &tm_info);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &tm_info);
     
     if (log_fp) {
+        flockfile(log_fp); // 多线程时保持单条日志完整
         fprintf(log_fp, "[%s] [%s] ", timestamp, level);
         va_start(args, message);
         vfprintf(log_fp, message, args);
         va_end(args);
         fprintf(log_fp, "\n");
         fflush(log_fp);
+        funlockfile(log_fp);
     }
     
     va_start(args, message);
@@ -77,18 +68,6 @@ void log_message(const char *level, const char *message, ...) {
     va_end(args);
 }
 
-// 处理终止信号
-void handle_signal(int sig) {
-    log_message("INFO", "收到信号 %d，关闭服务", sig);
-    if (server_fd != -1) {
-        close(server_fd);
-        unlink(SOCKET_PATH);
-    }
-    if (log_fp) fclose(log_fp);
-    closelog();
-    exit(0);
-}
-
 // 设置SELinux上下文
 int set_immutable_context(const char *path) {
     security_context_t current_context = NULL;
@@ -127,15 +106,58 @@ int set_immutable_context(const char *path) {
 
 // 获取完整路径
 char* get_full_path(const char *relative_path) {
-    static char full_path[MAX_PATH_LEN];
-    snprintf(full_path, MAX_PATH_LEN, "%s/%s", DATA_DIR, relative_path);
+    static __thread char full_path[MAX_PATH_LEN];
+    snprintf(full_path, MAX_PATH_LEN, "%s/%s", data_dir, relative_path);
     return full_path;
 }
 
-// 计算文件checksum (简化版)
+// 由完整路径得到相对于数据目录的路径, 不在数据目录下时返回NULL
+const char* relative_path_of(const char *full_path) {
+    size_t len = strlen(data_dir);
+    if (strncmp(full_path, data_dir, len) != 0 || full_path[len] != '/') {
+        return NULL;
+    }
+    return full_path + len + 1;
+}
+
+// 服务自身的内部文件, 不作为受保护对象
+int is_internal_file(const char *relative_path) {
+    return strcmp(relative_path, JOURNAL_FILE_NAME) == 0 ||
+           strcmp(relative_path, LOG_FILE_NAME) == 0 ||
+           strcmp(relative_path, SCRUB_STATE_FILE_NAME) == 0;
+}
+
+// 计算文件checksum (SHA-256)
 void calculate_checksum(const char *path, char *checksum, size_t checksum_size) {
-    snprintf(checksum, checksum_size, "checksum_%ld", time(NULL));
-    // 实际应用中应使用SHA256等哈希算法
+    sha256_ctx ctx;
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    char hex[SHA256_HEX_SIZE];
+    char buffer[64 * 1024];
+    ssize_t n;
+    int fd;
+    
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        log_message("ERROR", "无法读取文件计算校验和: %s", path);
+        snprintf(checksum, checksum_size, "unavailable");
+        return;
+    }
+    
+    sha256_init(&ctx);
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        sha256_update(&ctx, buffer, n);
+    }
+    close(fd);
+    
+    if (n < 0) {
+        log_message("ERROR", "读取文件时出错: %s", path);
+        snprintf(checksum, checksum_size, "unavailable");
+        return;
+    }
+    
+    sha256_final(&ctx, digest);
+    sha256_hex(digest, hex);
+    snprintf(checksum, checksum_size, "%s%s", CHECKSUM_PREFIX, hex);
 }
 
 // 保存文件元数据
@@ -158,6 +180,13 @@ int save_metadata(const char *path, file_metadata *metadata) {
     
     // 设置元数据文件的SELinux上下文
     set_immutable_context(meta_path);
+    
+    // 同步内存索引
+    const char *relative_path = relative_path_of(path);
+    struct stat st;
+    if (relative_path && stat(path, &st) == 0) {
+        object_index_put(relative_path, metadata, st.st_size);
+    }
     return 0;
 }
 
@@ -166,6 +195,7 @@ int load_metadata(const char *path, file_metadata *metadata) {
     char meta_path[MAX_PATH_LEN];
     FILE *fp;
     char line[256];
+    int fields = 0;
     
     snprintf(meta_path, MAX_PATH_LEN, "%s.meta", path);
     fp = fopen(meta_path, "r");
@@ -184,40 +214,81 @@ int load_metadata(const char *path, file_metadata *metadata) {
         if (key && value) {
             if (strcmp(key, "creation_time") == 0) {
                 metadata->creation_time = atol(value);
+                fields |= 1;
             } else if (strcmp(key, "modification_time") == 0) {
                 metadata->modification_time = atol(value);
+                fields |= 2;
             } else if (strcmp(key, "checksum") == 0) {
                 strncpy(metadata->checksum, value, sizeof(metadata->checksum)-1);
+                metadata->checksum[sizeof(metadata->checksum)-1] = '\0';
+                fields |= 4;
             }
         }
     }
     
     fclose(fp);
-    return 0;
+    
+    // 不完整的元数据 (例如写入中途崩溃) 视为无效
+    return fields == 7 ? 0 : -1;
 }
 
-// 验证请求
-int authenticate_request(request_header *req) {
-    // 令牌验证
-    if (strcmp(req->token, AUTH_TOKEN) != 0) {
-        log_message("WARNING", "认证失败: 无效令牌");
-        return 0;
-    }
+// 命令是否作用于单个文件 (需要路径)
+static int command_needs_path(command_type cmd) {
+    return cmd == CMD_MODIFY || cmd == CMD_DELETE ||
+           cmd == CMD_RSYNC_UPDATE || cmd == CMD_GET_INFO ||
+           cmd == CMD_APPEND || cmd == CMD_PATCH;
+}
+
+// 服务为对象创建的辅助文件和临时文件的后缀, 启动恢复时按后缀识别和清理
+static const char *const reserved_suffixes[] = { ".meta", ".source", MERKLE_SUFFIX };
+
+// 对象路径必须位于数据目录内: 各级名称非空且不为 . 或 .., 也不能是服务的内部文件
+// 或以保留后缀结尾 (否则会被当作其他对象的辅助文件)
+static int object_path_valid(const char *path) {
+    const char *p = path;
+    size_t path_len = strlen(path);
     
-    // 路径验证
-    if (strlen(req->path) == 0 || strlen(req->path) >= MAX_PATH_LEN) {
-        log_message("WARNING", "认证失败: 无效路径");
-        return 0;
+    if (is_internal_file(path)) return 0;
+    for (size_t i = 0; i < sizeof(reserved_suffixes) / sizeof(reserved_suffixes[0]); i++) {
+        size_t suffix_len = strlen(reserved_suffixes[i]);
+        if (path_len >= suffix_len && strcmp(path + path_len - suffix_len, reserved_suffixes[i]) == 0) {
+            return 0;
+        }
+    }
+    for (;;) {
+        const char *slash = strchr(p, '/');
+        size_t len = slash ? (size_t)(slash - p) : strlen(p);
+        if (len == 0 || (len == 1 && p[0] == '.') || (len == 2 && p[0] == '.' && p[1] == '.')) {
+            return 0;
+        }
+        if (!slash) return 1;
+        p = slash + 1;
+    }
+}
+
+// 验证请求: 身份已在会话建立时认证, 这里只检查命令权限和路径
+// 返回NULL表示通过, 否则返回拒绝原因
+static const char* check_request(const session *s, const request_header *req) {
+    // 权限验证 (位图查找)
+    if (!session_allows(s, req->cmd)) {
+        log_message("WARNING", "拒绝命令 %d (uid %d, pid %d): %s", req->cmd,
+                   (int)s->uid, (int)s->pid, s->allowed ? "权限不足" : "未授权的对端");
+        return s->allowed ? "权限不足" : "认证失败";
     }
     
-    // 时间戳验证 (防止重放攻击)
-    time_t now = time(NULL);
-    if (labs(now - req->timestamp) > 300) { // 5分钟内有效
-        log_message("WARNING", "认证失败: 过期请求");
-        return 0;
+    // 路径验证
+    size_t path_len = strnlen(req->path, MAX_PATH_LEN);
+    if (path_len >= MAX_PATH_LEN || (command_needs_path(req->cmd) && !object_path_valid(req->path))) {
+        log_message("WARNING", "拒绝命令 %d (uid %d): 无效路径", req->cmd, (int)s->uid);
+        return "无效路径";
     }
     
-    return 1;
+    return NULL;
+}
+
+// 检查是否满足最小保留期
+int retention_expired(const file_metadata *metadata) {
+    return difftime(time(NULL), metadata->creation_time) / 3600.0 >= MIN_RETENTION_HOURS;
 }
 
 // 检查文件能否删除 (基于保留期)
@@ -233,7 +304,7 @@ int can_delete_file(const char *path) {
     // 检查是否满足最小保留期
     double hours_since_creation = difftime(now, metadata.creation_time) / 3600.0;
     
-    if (hours_since_creation < MIN_RETENTION_HOURS) {
+    if (!retention_expired(&metadata)) {
         log_message("WARNING", "文件 %s 未达到最短保留期 (%.1f/%.1f 小时)", 
                    path, hours_since_creation, (double)MIN_RETENTION_HOURS);
         return 0;
@@ -242,13 +313,27 @@ int can_delete_file(const char *path) {
     return 1;
 }
 
+// 通知订阅者文件已变更; 新建的文件同时开始跟踪保留期
+static void notify_change(const char *path, watch_event_type type, int created,
+                          const file_metadata *metadata) {
+    const char *relative_path = relative_path_of(path);
+    if (!relative_path) return;
+    
+    if (created) {
+        watch_publish(WATCH_EVENT_CREATED, relative_path);
+        watch_track_retention(relative_path, metadata->creation_time);
+    } else {
+        watch_publish(type, relative_path);
+    }
+}
+
 // 修改文件
 int modify_file(const char *path, const char *data, size_t data_len) {
     FILE *fp;
     file_metadata metadata;
     
-    // 加载现有元数据
-    load_metadata(path, &metadata);
+    // 加载现有元数据 (没有有效元数据时视为新建)
+    int created = load_metadata(path, &metadata) != 0;
     
     // 打开并写入文件
     fp = fopen(path, "w");
@@ -265,9 +350,10 @@ int modify_file(const char *path, const char *data, size_t data_len) {
         return -1;
     }
     
-    // 更新元数据
+    // 更新元数据 (整体重写后哈希树失效)
     metadata.modification_time = time(NULL);
     calculate_checksum(path, metadata.checksum, sizeof(metadata.checksum));
+    merkle_remove(path);
     
     // 保存元数据
     if (save_metadata(path, &metadata) != 0) {
@@ -276,6 +362,7 @@ int modify_file(const char *path, const char *data, size_t data_len) {
     
     // 设置SELinux上下文
     set_immutable_context(path);
+    notify_change(path, WATCH_EVENT_MODIFIED, created, &metadata);
     
     log_message("INFO", "已成功修改文件: %s", path);
     return 0;
@@ -289,7 +376,11 @@ int delete_file(const char *path) {
         return -1;
     }
     
-    // 删除文件和元数据
+    return remove_file(path);
+}
+
+// 删除文件及其元数据 (不检查保留期)
+int remove_file(const char *path) {
     char meta_path[MAX_PATH_LEN];
     snprintf(meta_path, MAX_PATH_LEN, "%s.meta", path);
     
@@ -299,6 +390,13 @@ int delete_file(const char *path) {
     }
     
     unlink(meta_path); // 忽略元数据删除失败
+    merkle_remove(path);
+    
+    const char *relative_path = relative_path_of(path);
+    if (relative_path) {
+        object_index_remove(relative_path);
+        watch_publish(WATCH_EVENT_DELETED, relative_path);
+    }
     
     log_message("INFO", "已成功删除文件: %s", path);
     return 0;
@@ -310,6 +408,7 @@ int rsync_update(const char *path, const char *source_data, size_t data_len) {
     char command[MAX_PATH_LEN * 2];
     FILE *fp;
     int result;
+    int created;
     
     // 创建临时源文件
     snprintf(temp_path, MAX_PATH_LEN, "%s.source", path);
@@ -344,30 +443,287 @@ int rsync_update(const char *path, const char *source_data, size_t data_len) {
     
     // 更新元数据
     file_metadata metadata;
-    load_metadata(path, &metadata);
+    created = load_metadata(path, &metadata) != 0;
     metadata.modification_time = time(NULL);
     calculate_checksum(path, metadata.checksum, sizeof(metadata.checksum));
+    merkle_remove(path);
     save_metadata(path, &metadata);
     
     // 设置SELinux上下文
     set_immutable_context(path);
+    notify_change(path, WATCH_EVENT_UPDATED, created, &metadata);
     
     log_message("INFO", "已成功增量更新文件: %s", path);
     return 0;
 }
 
+// 完整写入一组 iovec, 处理短写
+static int pwritev_full(int fd, struct iovec *iov, int count, off_t offset) {
+    while (count > 0) {
+        ssize_t n = pwritev(fd, iov, count, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        offset += n;
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+// 按偏移写入区段 (追加在日志中也记录为区段), 校验和通过哈希树增量更新
+int patch_file(const char *path, const char *data, size_t data_len) {
+    const char *p = data;
+    const char *end = data + data_len;
+    size_t max_count = data_len / sizeof(patch_extent) + 1;
+    struct iovec *iov = malloc(max_count * sizeof(struct iovec));
+    merkle_range *ranges = malloc(max_count * sizeof(merkle_range));
+    file_metadata metadata;
+    char checksum[CHECKSUM_SIZE];
+    struct stat st;
+    size_t count = 0, written = 0;
+    uint64_t size;
+    int fd = -1;
+    int created;
+    int new_file = 0;
+    int result = -1;
+    
+    if (!iov || !ranges) goto out;
+    
+    // 加载现有元数据 (保留创建时间)
+    created = load_metadata(path, &metadata) != 0;
+    
+    // 文件不存在时按空文件检查区段, 检查通过后才创建
+    fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd == -1 && errno == ENOENT) {
+        st.st_size = 0;
+        new_file = 1;
+    } else if (fd == -1 || fstat(fd, &st) != 0) {
+        log_message("ERROR", "无法打开文件进行写入: %s", path);
+        goto out;
+    }
+    
+    // 先解析并检查全部区段, 任何一个无效则不写入
+    size = st.st_size;
+    while (p < end) {
+        patch_extent extent;
+        if ((size_t)(end - p) < sizeof(extent)) break;
+        memcpy(&extent, p, sizeof(extent));
+        p += sizeof(extent);
+        if (extent.length == 0 || extent.length > (uint64_t)(end - p) || extent.offset > size) break;
+        
+        ranges[count].offset = extent.offset;
+        ranges[count].length = extent.length;
+        iov[count].iov_base = (void *)p;
+        iov[count].iov_len = extent.length;
+        count++;
+        p += extent.length;
+        written += extent.length;
+        if (extent.offset + extent.length > size) size = extent.offset + extent.length;
+    }
+    if (p != end || count == 0) {
+        log_message("WARNING", "无效的区段列表, 拒绝写入: %s", path);
+        goto out;
+    }
+    
+    if (new_file) {
+        fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            log_message("ERROR", "无法创建文件: %s", path);
+            new_file = 0;
+            goto out;
+        }
+    }
+    
+    // 首尾相接的区段合并为一次 pwritev
+    for (size_t i = 0; i < count; ) {
+        size_t j = i + 1;
+        while (j < count && j - i < IOV_MAX &&
+               ranges[j].offset == ranges[j - 1].offset + ranges[j - 1].length) {
+            j++;
+        }
+        if (pwritev_full(fd, iov + i, j - i, ranges[i].offset) != 0) {
+            log_message("ERROR", "写入文件时出错: %s", path);
+            goto out;
+        }
+        i = j;
+    }
+    close(fd);
+    fd = -1;
+    
+    // 更新元数据: 只重新哈希涉及的块
+    metadata.modification_time = time(NULL);
+    if (merkle_update(path, metadata.checksum, ranges, count, checksum, sizeof(checksum)) != 0) {
+        snprintf(checksum, sizeof(checksum), "unavailable");
+    }
+    memcpy(metadata.checksum, checksum, sizeof(metadata.checksum));
+    
+    if (save_metadata(path, &metadata) != 0) {
+        log_message("WARNING", "无法保存元数据: %s", path);
+    }
+    
+    // 设置SELinux上下文
+    set_immutable_context(path);
+    notify_change(path, WATCH_EVENT_PATCHED, created, &metadata);
+    
+    log_message("INFO", "已成功写入文件: %s (%zu 个区段, %zu 字节)", path, count, written);
+    result = 0;
+    
+out:
+    if (fd != -1) close(fd);
+    // 写入失败时不留下本次新建的半成品文件
+    if (result != 0 && new_file) unlink(path);
+    free(iov);
+    free(ranges);
+    return result;
+}
+
+// 完整接收 len 字节
+ssize_t recv_all(int fd, void *buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = recv(fd, (char *)buf + done, len - done, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        done += n;
+    }
+    return done;
+}
+
+// 完整发送 len 字节
+ssize_t send_all(int fd, const void *buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = send(fd, (const char *)buf + done, len - done, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        done += n;
+    }
+    return done;
+}
+
+// 发送响应头和响应内容
+int send_response(int fd, int status, const void *body, size_t length) {
+    response_header resp;
+    
+    resp.status = status;
+    resp.length = length;
+    if (send_all(fd, &resp, sizeof(resp)) != sizeof(resp) ||
+        (length > 0 && send_all(fd, body, length) != (ssize_t)length)) {
+        return -1;
+    }
+    return 0;
+}
+
+// 按路径哈希分段的锁, 串行化同一文件上的并发变更
+#define PATH_LOCK_STRIPES 256
+static pthread_mutex_t path_locks[PATH_LOCK_STRIPES];
+
+// 可重入: 持有路径锁的调用者 (例如 CMD_GET_INFO) 仍可通过索引惰性验证同一路径
+static void init_path_locks(void) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    for (int i = 0; i < PATH_LOCK_STRIPES; i++) {
+        pthread_mutex_init(&path_locks[i], &attr);
+    }
+    pthread_mutexattr_destroy(&attr);
+}
+
+pthread_mutex_t *path_lock_of(const char *relative_path) {
+    unsigned long h = 5381;
+    while (*relative_path) {
+        h = h * 33 + (unsigned char)*relative_path++;
+    }
+    return &path_locks[h % PATH_LOCK_STRIPES];
+}
+
+// 执行变更操作: 先写入日志, 再应用, 最后记录结果
+int execute_mutation(command_type cmd, const char *relative_path, const char *full_path,
+                     const char *data, size_t data_len) {
+    pthread_mutex_t *lock;
+    journal_txn txn;
+    char *append_buffer = NULL;
+    int result = -1;
+    
+    if (replication_get_role() == ROLE_STANDBY) {
+        log_message("WARNING", "备用实例只读, 拒绝命令 %d: %s", cmd, relative_path);
+        return -1;
+    }
+    
+    // 同一路径上日志顺序与应用顺序一致
+    lock = path_lock_of(relative_path);
+    pthread_mutex_lock(lock);
+    
+    // 追加在日志中记录为确定偏移的区段写入, 重做时不会重复追加
+    if (cmd == CMD_APPEND) {
+        struct stat st;
+        patch_extent extent;
+        
+        append_buffer = malloc(sizeof(extent) + data_len);
+        if (!append_buffer) {
+            pthread_mutex_unlock(lock);
+            return -1;
+        }
+        extent.offset = stat(full_path, &st) == 0 ? (uint64_t)st.st_size : 0;
+        extent.length = data_len;
+        memcpy(append_buffer, &extent, sizeof(extent));
+        memcpy(append_buffer + sizeof(extent), data, data_len);
+        cmd = CMD_PATCH;
+        data = append_buffer;
+        data_len += sizeof(extent);
+    }
+    
+    if (journal_append(cmd, relative_path, data, data_len, &txn) != 0) {
+        log_message("ERROR", "无法写入日志, 拒绝命令 %d: %s", cmd, relative_path);
+        pthread_mutex_unlock(lock);
+        free(append_buffer);
+        return -1;
+    }
+    
+    switch (cmd) {
+        case CMD_MODIFY:
+            result = modify_file(full_path, data, data_len);
+            break;
+        case CMD_DELETE:
+            result = delete_file(full_path);
+            break;
+        case CMD_RSYNC_UPDATE:
+            result = rsync_update(full_path, data, data_len);
+            break;
+        case CMD_PATCH:
+            result = patch_file(full_path, data, data_len);
+            break;
+        default:
+            break;
+    }
+    
+    journal_finish(&txn, result == 0);
+    pthread_mutex_unlock(lock);
+    free(append_buffer);
+    return result;
+}
+
 // 获取文件信息
 int get_file_info(const char *path, char *info_buffer, size_t buffer_size) {
     struct stat st;
     file_metadata metadata;
+    const char *relative_path = relative_path_of(path);
+    char created[32], modified[32];
     
-    if (stat(path, &st) != 0) {
+    // 元数据来自索引 (恢复扫描期间按需验证)
+    if (!relative_path || stat(path, &st) != 0 ||
+        object_index_lookup(relative_path, &metadata, NULL) != 0) {
         snprintf(info_buffer, buffer_size, "文件不存在");
         return -1;
     }
     
-    load_metadata(path, &metadata);
-    
     snprintf(info_buffer, buffer_size,
             "文件: %s\n"
             "大小: %ld 字节\n"
@@ -376,33 +732,436 @@ int get_file_info(const char *path, char *info_buffer, size_t buffer_size) {
             "保留期满: %s\n"
             "校验和: %s\n",
             path, st.st_size,
-            ctime(&metadata.creation_time),
-            ctime(&metadata.modification_time),
-            can_delete_file(path) ? "是" : "否",
+            ctime_r(&metadata.creation_time, created),
+            ctime_r(&metadata.modification_time, modified),
+            retention_expired(&metadata) ? "是" : "否",
             metadata.checksum);
     
     return 0;
 }
 
-int main() {
-    struct sockaddr_un server_addr, client_addr;
-    socklen_t client_len = sizeof(client_addr);
-    int client_fd;
-    request_header req;
+// 按前缀分页列举对象: 路径来自索引的有序跳表, 元数据来自索引
+// 重启后尚未验证的条目在首次附带元数据列举时按需 stat 并读取 .meta, 之后由索引直接返回
+static int list_objects(const char *prefix, const list_request *lr, char **out, size_t *out_len) {
+    size_t limit = lr->limit ? lr->limit : LIST_DEFAULT_LIMIT;
+    int with_metadata = (lr->flags & LIST_WITH_METADATA) != 0;
+    list_response resp;
+    char **paths;
+    char *buffer, *p;
+    size_t n, total;
+    const char *cursor;
+    
+    if (strnlen(lr->cursor, MAX_PATH_LEN) >= MAX_PATH_LEN) return -1;
+    if (limit > LIST_MAX_LIMIT) limit = LIST_MAX_LIMIT;
+    
+    // 多取一条判断是否还有后续页
+    paths = malloc((limit + 1) * sizeof(char *));
+    if (!paths) return -1;
+    n = object_index_list(prefix, lr->cursor, limit + 1, paths);
+    
+    memset(&resp, 0, sizeof(resp));
+    if (n > limit) {
+        free(paths[--n]);
+        resp.more = 1;
+    }
+    cursor = n > 0 ? paths[n - 1] : lr->cursor;
+    resp.cursor_len = strlen(cursor);
+    
+    total = sizeof(resp) + resp.cursor_len;
+    for (size_t i = 0; i < n; i++) {
+        total += sizeof(uint16_t) + strlen(paths[i]) + (with_metadata ? sizeof(list_record) : 0);
+    }
+    buffer = malloc(total);
+    if (!buffer) {
+        for (size_t i = 0; i < n; i++) free(paths[i]);
+        free(paths);
+        return -1;
+    }
+    
+    p = buffer + sizeof(resp);
+    memcpy(p, cursor, resp.cursor_len);
+    p += resp.cursor_len;
+    for (size_t i = 0; i < n; i++) {
+        uint16_t path_len = strlen(paths[i]);
+        list_record record;
+        
+        if (with_metadata) {
+            file_metadata metadata;
+            off_t size = 0;
+            
+            // 已验证的条目直接来自内存; 列举期间被删除的对象跳过
+            if (object_index_lookup(paths[i], &metadata, &size) != 0) continue;
+            memset(&record, 0, sizeof(record));
+            record.size = size;
+            record.creation_time = metadata.creation_time;
+            record.modification_time = metadata.modification_time;
+            record.retention_expired = retention_expired(&metadata);
+            memcpy(record.checksum, metadata.checksum, sizeof(record.checksum));
+        }
+        
+        memcpy(p, &path_len, sizeof(path_len));
+        p += sizeof(path_len);
+        memcpy(p, paths[i], path_len);
+        p += path_len;
+        if (with_metadata) {
+            memcpy(p, &record, sizeof(record));
+            p += sizeof(record);
+        }
+        resp.count++;
+    }
+    memcpy(buffer, &resp, sizeof(resp));
+    
+    for (size_t i = 0; i < n; i++) free(paths[i]);
+    free(paths);
+    *out = buffer;
+    *out_len = p - buffer;
+    return 0;
+}
+
+// 带数据的写入为大请求, 其余为小请求
+request_class classify_request(const request_header *req) {
+    if ((req->cmd == CMD_MODIFY || req->cmd == CMD_RSYNC_UPDATE || req->cmd == CMD_REPLICATE ||
+         req->cmd == CMD_APPEND || req->cmd == CMD_PATCH) && req->data_len > 0) {
+        return CLASS_LARGE;
+    }
+    return CLASS_SMALL;
+}
+
+// 请求处理完毕: 连接继续等待下一个请求, 出错时关闭
+static void connection_done(session *s, int keep) {
+    struct epoll_event ev;
+    
+    if (keep) {
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLONESHOT;
+        ev.data.ptr = s;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, s->fd, &ev) == 0) return;
+    }
+    session_close(s);
+}
+
+// 在工作线程中处理一个已通过认证的请求
+void handle_request(sched_job *job) {
+    request_header *req = &job->req;
+    int client_fd = job->session->fd;
+    int body_read = 0;
     void *data_buffer = NULL;
     char *full_path = NULL;
     
+    // 获取完整路径
+    full_path = get_full_path(req->path);
+    log_message("INFO", "处理命令: %d, 路径: %s", req->cmd, full_path);
+    
+    int result = -1;
+    char info_buffer[4096] = {0};
+    char *list_buffer = NULL;
+    size_t list_len = 0;
+    list_request list_req;
+    watch_request watch_req;
+    int watching = 0;
+    repl_ack ack;
+    
+    // 处理命令
+    switch(req->cmd) {
+        case CMD_MODIFY:
+            if (req->data_len > 0 && req->data_len < MAX_DATA_SIZE) {
+                data_buffer = malloc(req->data_len);
+                if (data_buffer) {
+                    if (recv_all(client_fd, data_buffer, req->data_len) == (ssize_t)req->data_len) {
+                        body_read = 1;
+                        result = execute_mutation(CMD_MODIFY, req->path, full_path, data_buffer, req->data_len);
+                    }
+                    free(data_buffer);
+                }
+            }
+            break;
+            
+        case CMD_DELETE:
+            result = execute_mutation(CMD_DELETE, req->path, full_path, NULL, 0);
+            break;
+            
+        case CMD_RSYNC_UPDATE:
+            if (req->data_len > 0 && req->data_len < MAX_DATA_SIZE) {
+                data_buffer = malloc(req->data_len);
+                if (data_buffer) {
+                    if (recv_all(client_fd, data_buffer, req->data_len) == (ssize_t)req->data_len) {
+                        body_read = 1;
+                        result = execute_mutation(CMD_RSYNC_UPDATE, req->path, full_path, data_buffer, req->data_len);
+                    }
+                    free(data_buffer);
+                }
+            }
+            break;
+            
+        case CMD_APPEND:
+        case CMD_PATCH:
+            // 追加在日志中会加上一个区段头, 总大小仍受 MAX_DATA_SIZE 限制
+            if (req->data_len > 0 && req->data_len < MAX_DATA_SIZE - sizeof(patch_extent)) {
+                data_buffer = malloc(req->data_len);
+                if (data_buffer) {
+                    if (recv_all(client_fd, data_buffer, req->data_len) == (ssize_t)req->data_len) {
+                        body_read = 1;
+                        result = execute_mutation(req->cmd, req->path, full_path, data_buffer, req->data_len);
+                    }
+                    free(data_buffer);
+                }
+            }
+            break;
+            
+        case CMD_LIST:
+            if (req->data_len == sizeof(list_req) &&
+                recv_all(client_fd, &list_req, sizeof(list_req)) == sizeof(list_req)) {
+                body_read = 1;
+                result = list_objects(req->path, &list_req, &list_buffer, &list_len);
+            }
+            break;
+            
+        case CMD_WATCH:
+            if (req->data_len == sizeof(watch_req) &&
+                recv_all(client_fd, &watch_req, sizeof(watch_req)) == sizeof(watch_req)) {
+                body_read = 1;
+                // 连接此后只用于推送事件, 交给推送线程; 订阅失败时回复原因后关闭
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client_fd, NULL);
+                watching = 1;
+                result = watch_subscribe(job->session, req->path, &watch_req);
+                if (result == 0) return;
+            }
+            break;
+            
+        case CMD_GET_INFO:
+            // 等待同一文件上进行中的写入, 避免读到写了一半的状态
+            pthread_mutex_lock(path_lock_of(req->path));
+            result = get_file_info(full_path, info_buffer, sizeof(info_buffer));
+            pthread_mutex_unlock(path_lock_of(req->path));
+            break;
+            
+        case CMD_REPLICATE:
+            memset(&ack, 0, sizeof(ack));
+            ack.status = -1;
+            if (req->data_len <= REPL_MAX_BATCH_BYTES) {
+                data_buffer = malloc(req->data_len ? req->data_len : 1);
+                if (data_buffer) {
+                    if (recv_all(client_fd, data_buffer, req->data_len) == (ssize_t)req->data_len) {
+                        body_read = 1;
+                        result = replication_apply_batch(data_buffer, req->data_len, &ack);
+                    }
+                    free(data_buffer);
+                }
+            }
+            break;
+            
+        case CMD_REPL_STATUS:
+            result = replication_status(info_buffer, sizeof(info_buffer));
+            if (result == 0) {
+                size_t used = strlen(info_buffer);
+                recovery_status(info_buffer + used, sizeof(info_buffer) - used);
+                used = strlen(info_buffer);
+                scheduler_status(info_buffer + used, sizeof(info_buffer) - used);
+                used = strlen(info_buffer);
+                watch_status(info_buffer + used, sizeof(info_buffer) - used);
+            }
+            break;
+            
+        case CMD_PROMOTE:
+            result = replication_promote();
+            break;
+            
+        case CMD_SCRUB_START:
+            scrubber_trigger();
+            /* fall through */
+        case CMD_SCRUB_REPORT:
+            result = scrubber_report(info_buffer, sizeof(info_buffer));
+            break;
+            
+        default:
+            log_message("WARNING", "未知命令: %d", req->cmd);
+            break;
+    }
+    
+    // 回传结果
+    const char *msg;
+    int sent;
+    if (req->cmd == CMD_GET_INFO || req->cmd == CMD_REPL_STATUS ||
+        req->cmd == CMD_SCRUB_REPORT || req->cmd == CMD_SCRUB_START) {
+        // 发送文件信息
+        sent = send_response(client_fd, result, info_buffer, strlen(info_buffer));
+    } else if (req->cmd == CMD_REPLICATE) {
+        // 发送复制应答
+        sent = send_response(client_fd, result, &ack, sizeof(ack));
+    } else if (req->cmd == CMD_LIST && result == 0) {
+        // 发送列举结果
+        sent = send_response(client_fd, 0, list_buffer, list_len);
+        free(list_buffer);
+    } else {
+        // 发送操作结果; 订阅被拒绝时回复具体原因, 客户端据此决定重试还是重新订阅
+        if (result == WATCH_REJECT_BUSY) msg = "订阅者过多";
+        else if (result == WATCH_REJECT_INVALID_SEQ) msg = "无效的事件序号";
+        else msg = (result == 0) ? "操作成功" : "操作失败";
+        sent = send_response(client_fd, result, msg, strlen(msg));
+    }
+    
+    // 声明的数据未被完整读取时无法定位下一个请求, 关闭连接
+    connection_done(job->session, sent == 0 && !watching && (req->data_len == 0 || body_read));
+}
+
+// 在接收线程中读取请求头, 检查权限后提交给调度器
+// 只读取已到达的数据, 请求头不完整时暂存在会话中, 慢速客户端不会阻塞其他连接
+static void receive_request(session *s) {
+    request_header req;
+    const char *reject;
+    ssize_t n;
+    
+    n = recv(s->fd, (char *)&s->header + s->header_len, sizeof(s->header) - s->header_len, MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        // 对端关闭连接
+        session_close(s);
+        return;
+    }
+    if (n > 0) s->header_len += n;
+    if (s->header_len < sizeof(s->header)) {
+        connection_done(s, 1);
+        return;
+    }
+    req = s->header;
+    s->header_len = 0;
+    s->requests++;
+    
+    reject = check_request(s, &req);
+    if (!reject) {
+        // 按类别提交给调度器; 超出限制时明确返回繁忙
+        sched_job *job = calloc(1, sizeof(sched_job));
+        if (job) {
+            job->session = s;
+            job->req = req;
+            job->uid = s->uid;
+            job->pid = s->pid;
+            job->cls = classify_request(&req);
+            if (scheduler_submit(job) == 0) return;
+            free(job);
+        }
+        reject = "服务繁忙";
+    }
+    
+    // 未读取的请求数据无法跳过, 只能关闭连接
+    send_response(s->fd, -1, reject, strlen(reject));
+    connection_done(s, req.data_len == 0);
+}
+
+// 接受新连接并建立会话, 对端凭据由内核提供, 每个连接只认证一次
+static void accept_connection(void) {
+    struct timeval io_timeout = { SCHED_HEADER_TIMEOUT_SEC, 0 };
+    struct epoll_event ev;
+    session *s;
+    int client_fd;
+    
+    client_fd = accept4(server_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (client_fd == -1) {
+        log_message("ERROR", "接受连接失败: %s", strerror(errno));
+        return;
+    }
+    
+    s = session_open(client_fd);
+    if (!s) {
+        close(client_fd);
+        return;
+    }
+    
+    // 慢速客户端不能无限期占用工作线程 (接收请求数据时)
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &io_timeout, sizeof(io_timeout));
+    
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.ptr = s;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) != 0) {
+        log_message("ERROR", "无法监听连接: %s", strerror(errno));
+        session_close(s);
+    }
+}
+
+void print_usage(const char *prog_name) {
+    printf("用法: %s [-d 数据目录] [-s socket路径] [-r 备用实例socket] [-S] [-j 恢复线程数]\n"
+           "          [-t 巡检线程数] [-b 巡检限速MB/s] [-w 工作线程数]\n"
+           "          [-u uid[,uid...]] [-n]\n", prog_name);
+    printf("选项:\n");
+    printf("  -d  数据目录 (默认 %s)\n", DATA_DIR);
+    printf("  -s  监听的socket路径 (默认 %s)\n", SOCKET_PATH);
+    printf("  -r  将操作日志复制到该socket上的备用实例\n");
+    printf("  -S  以备用实例身份运行, 只接受复制数据, 直到被提升\n");
+    printf("  -j  启动恢复扫描的线程数 (默认为CPU数)\n");
+    printf("  -t  完整性巡检线程数, 0 表示禁用 (默认 %d)\n", SCRUB_DEFAULT_THREADS);
+    printf("  -b  完整性巡检读取限速 MB/s, 0 表示不限速 (默认 %d)\n", SCRUB_DEFAULT_RATE_MB);
+    printf("  -w  处理请求的工作线程数, 至少 %d (默认 %d)\n", SCHED_MIN_WORKERS, SCHED_DEFAULT_WORKERS);
+    printf("  -u  允许执行客户端命令的uid (root和服务自身用户总是允许)\n");
+    printf("  -n  用 fanotify 向订阅者报告绕过服务对数据目录的写入 (需要 CAP_SYS_ADMIN)\n");
+}
+
+int main(int argc, char *argv[]) {
+    struct sockaddr_un server_addr;
+    struct epoll_event ev, events[64];
+    const char *standby_socket = NULL;
+    replication_role role = ROLE_PRIMARY;
+    char log_file[MAX_PATH_LEN];
+    int recovery_threads = 0;
+    int scrub_threads = SCRUB_DEFAULT_THREADS;
+    long scrub_rate_mb = SCRUB_DEFAULT_RATE_MB;
+    int workers = SCHED_DEFAULT_WORKERS;
+    int use_fanotify = 0;
+    struct timespec start_time, ready_time;
+    sigset_t signals;
+    int running = 1;
+    int opt;
+    
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    
+    while ((opt = getopt(argc, argv, "d:s:r:Sj:t:b:w:u:nh")) != -1) {
+        switch (opt) {
+            case 'd': data_dir = optarg; break;
+            case 's': socket_path = optarg; break;
+            case 'r': standby_socket = optarg; break;
+            case 'S': role = ROLE_STANDBY; break;
+            case 'j': recovery_threads = atoi(optarg); break;
+            case 't': scrub_threads = atoi(optarg); break;
+            case 'b': scrub_rate_mb = atol(optarg); break;
+            case 'w': workers = atoi(optarg); break;
+            case 'n': use_fanotify = 1; break;
+            case 'u':
+                if (session_allow_uids(optarg) != 0) {
+                    fprintf(stderr, "无效的uid列表: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            default:
+                print_usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    
+    // 创建数据目录
+    mkdir(data_dir, 0755);
+    
     // 初始化日志
     openlog("immutable_service", LOG_PID, LOG_DAEMON);
-    log_fp = fopen(LOG_FILE, "a");
-    log_message("INFO", "不可变文件管理服务启动");
+    snprintf(log_file, sizeof(log_file), "%s/%s", data_dir, LOG_FILE_NAME);
+    log_fp = fopen(log_file, "a");
+    log_message("INFO", "不可变文件管理服务启动 (%s)", role == ROLE_STANDBY ? "备用实例" : "主实例");
     
-    // 创建数据目录
-    mkdir(DATA_DIR, 0755);
+    // 内存对象索引 (由恢复扫描重建, 重做日志时也会写入)
+    object_index_init();
+    init_path_locks();
+    
+    // 终止信号在所有线程中屏蔽 (此后创建的线程继承), 由主循环通过 signalfd 处理:
+    // 关闭流程需要加锁并等待日志传送线程, 不能在信号处理函数中进行
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    signal(SIGPIPE, SIG_IGN);
     
-    // 设置信号处理
-    signal(SIGINT, handle_signal);
-    signal(SIGTERM, handle_signal);
+    // 打开操作日志 (主实例会重做未完成的操作)
+    if (journal_open(data_dir, role) != 0) {
+        log_message("ERROR", "无法打开操作日志, 退出");
+        return 1;
+    }
     
     // 创建socket
     server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
@@ -414,10 +1173,10 @@ int main() {
     // 准备地址
     memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sun_family = AF_UNIX;
-    strncpy(server_addr.sun_path, SOCKET_PATH, sizeof(server_addr.sun_path) - 1);
+    strncpy(server_addr.sun_path, socket_path, sizeof(server_addr.sun_path) - 1);
     
     // 删除可能存在的旧socket文件
-    unlink(SOCKET_PATH);
+    unlink(socket_path);
     
     // 绑定地址
     if (bind(server_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) == -1) {
@@ -427,108 +1186,102 @@ int main() {
     }
     
     // 设置socket权限
-    chmod(SOCKET_PATH, 0666);
+    chmod(socket_path, 0666);
     
     // 监听连接
     if (listen(server_fd, 5) == -1) {
         log_message("ERROR", "无法监听socket: %s", strerror(errno));
         close(server_fd);
-        unlink(SOCKET_PATH);
+        unlink(socket_path);
         return 1;
     }
     
-    log_message("INFO", "等待连接在 %s", SOCKET_PATH);
+    log_message("INFO", "等待连接在 %s", socket_path);
     
-    // 主循环
-    while (1) {
-        client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_len);
-        if (client_fd == -1) {
-            log_message("ERROR", "接受连接失败: %s", strerror(errno));
-            continue;
-        }
-        
-        log_message("INFO", "接受新连接");
-        
-        // 接收请求头
-        if (recv(client_fd, &req, sizeof(req), 0) != sizeof(req)) {
-            log_message("ERROR", "接收请求失败");
-            close(client_fd);
-            continue;
-        }
-        
-        // 验证请求
-        if (!authenticate_request(&req)) {
-            const char *msg = "认证失败";
-            send(client_fd, msg, strlen(msg), 0);
-            close(client_fd);
+    // 后台并行恢复; 扫描期间的读取通过索引惰性验证
+    if (recovery_start(data_dir, recovery_threads) != 0) {
+        log_message("ERROR", "无法启动恢复扫描");
+    }
+    
+    // 后台完整性巡检 (等待恢复完成后开始)
+    scrubber_start(data_dir, scrub_threads, scrub_rate_mb);
+    
+    // 变更事件推送 (CMD_WATCH)
+    if (watch_start(data_dir, use_fanotify) != 0) {
+        log_message("ERROR", "无法启动事件推送");
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &ready_time);
+    log_message("INFO", "服务就绪, 启动耗时 %ld ms",
+               (ready_time.tv_sec - start_time.tv_sec) * 1000L +
+               (ready_time.tv_nsec - start_time.tv_nsec) / 1000000L);
+    
+    // 启动请求处理线程池
+    if (scheduler_start(workers, handle_request) != 0) {
+        log_message("ERROR", "无法启动工作线程, 退出");
+        close(server_fd);
+        unlink(socket_path);
+        return 1;
+    }
+    
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;     // 监听socket
+    if (epoll_fd == -1 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_fd, &ev) != 0) {
+        log_message("ERROR", "无法创建epoll: %s", strerror(errno));
+        close(server_fd);
+        unlink(socket_path);
+        return 1;
+    }
+    signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+    ev.data.ptr = &signal_fd;   // 终止信号
+    if (signal_fd == -1 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &ev) != 0) {
+        log_message("ERROR", "无法创建signalfd: %s", strerror(errno));
+        close(server_fd);
+        unlink(socket_path);
+        return 1;
+    }
+    
+    // 启动日志传送 (仅主实例)
+    if (standby_socket && role == ROLE_PRIMARY && replication_start(standby_socket) != 0) {
+        log_message("ERROR", "无法启动日志传送, 退出");
+        close(server_fd);
+        unlink(socket_path);
+        return 1;
+    }
+    
+    // 主循环: 接受连接, 读取已就绪连接上的请求头
+    // 连接上的请求处理完毕前不会再次就绪 (EPOLLONESHOT), 同一连接上的请求按顺序处理
+    while (running) {
+        int n = epoll_wait(epoll_fd, events, 64, -1);
+        if (n == -1) {
+            if (errno != EINTR) log_message("ERROR", "epoll_wait失败: %s", strerror(errno));
             continue;
         }
-        
-        // 获取完整路径
-        full_path = get_full_path(req.path);
-        log_message("INFO", "处理命令: %d, 路径: %s", req.cmd, full_path);
-        
-        int result = -1;
-        char info_buffer[4096] = {0};
-        
-        // 处理命令
-        switch(req.cmd) {
-            case CMD_MODIFY:
-                if (req.data_len > 0 && req.data_len < MAX_DATA_SIZE) {
-                    data_buffer = malloc(req.data_len);
-                    if (data_buffer) {
-                        if (recv(client_fd, data_buffer, req.data_len, 0) == req.data_len) {
-                            result = modify_file(full_path, data_buffer, req.data_len);
-                        }
-                        free(data_buffer);
-                    }
-                }
-                break;
-                
-            case CMD_DELETE:
-                result = delete_file(full_path);
-                break;
-                
-            case CMD_RSYNC_UPDATE:
-                if (req.data_len > 0 && req.data_len < MAX_DATA_SIZE) {
-                    data_buffer = malloc(req.data_len);
-                    if (data_buffer) {
-                        if (recv(client_fd, data_buffer, req.data_len, 0) == req.data_len) {
-                            result = rsync_update(full_path, data_buffer, req.data_len);
-                        }
-                        free(data_buffer);
-                    }
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == NULL) {
+                accept_connection();
+            } else if (events[i].data.ptr == &signal_fd) {
+                struct signalfd_siginfo info;
+                if (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+                    log_message("INFO", "收到信号 %d，关闭服务", (int)info.ssi_signo);
+                    running = 0;
                 }
-                break;
-                
-            case CMD_GET_INFO:
-                result = get_file_info(full_path, info_buffer, sizeof(info_buffer));
-                break;
-                
-            default:
-                log_message("WARNING", "未知命令: %d", req.cmd);
-                break;
-        }
-        
-        // 回传结果
-        const char *msg;
-        if (req.cmd == CMD_GET_INFO) {
-            // 发送文件信息
-            send(client_fd, info_buffer, strlen(info_buffer), 0);
-        } else {
-            // 发送操作结果
-            msg = (result == 0) ? "操作成功" : "操作失败";
-            send(client_fd, msg, strlen(msg), 0);
+            } else {
+                receive_request(events[i].data.ptr);
+            }
         }
-        
-        close(client_fd);
     }
     
-    // 清理
+    // 清理: 不再接受连接, 等待进行中的请求完成后再关闭操作日志
+    // (巡检等后台线程仍可能写服务日志, 日志文件由 exit 刷新关闭)
     close(server_fd);
-    unlink(SOCKET_PATH);
-    if (log_fp) fclose(log_fp);
+    unlink(socket_path);
+    scheduler_stop();
+    journal_close();
+    log_message("INFO", "服务已关闭");
     closelog();
     
     return 0;
-} 
\ No newline at end of file
+}
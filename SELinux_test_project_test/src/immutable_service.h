@@ -0,0 +1,159 @@
+#ifndef IMMUTABLE_SERVICE_H
+#define IMMUTABLE_SERVICE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <time.h>
+
+// 配置 (默认值, 可通过命令行参数覆盖)
+#define SOCKET_PATH "/tmp/immutable_service.sock"
+#define DATA_DIR "/Users/amireuxjoe/SELinux/SELinux_test_project_test/data"
+#define LOG_FILE_NAME "service.log"
+#define MAX_PATH_LEN 1024
+#define MAX_DATA_SIZE (10 * 1024 * 1024) // 10MB
+#define MIN_RETENTION_HOURS 24  // 文件保留最少24小时
+#define CHECKSUM_PREFIX "sha256:"
+#define CHECKSUM_SIZE 72        // "sha256:" + 64位十六进制 + '\0'
+
+// 命令类型
+typedef enum {
+    CMD_MODIFY = 1,        // 修改文件
+    CMD_DELETE = 2,        // 删除文件
+    CMD_RSYNC_UPDATE = 3,  // 增量更新
+    CMD_GET_INFO = 4,      // 获取文件信息
+    CMD_REPLICATE = 5,     // 日志复制 (主实例 -> 备用实例)
+    CMD_REPL_STATUS = 6,   // 获取复制状态
+    CMD_PROMOTE = 7,       // 将备用实例提升为主实例
+    CMD_SCRUB_REPORT = 8,  // 获取完整性巡检报告
+    CMD_SCRUB_START = 9,   // 立即开始新一轮完整性巡检
+    CMD_APPEND = 10,       // 在文件末尾追加
+    CMD_PATCH = 11,        // 按偏移写入若干区段
+    CMD_LIST = 12,         // 按前缀分页列举对象
+    CMD_WATCH = 13         // 订阅前缀下的变更事件 (连接此后只用于推送事件)
+} command_type;
+
+// 请求头 (连接建立时由对端凭据认证, 请求本身不携带令牌)
+typedef struct {
+    command_type cmd;
+    char path[MAX_PATH_LEN];
+    size_t data_len;
+} request_header;
+
+// CMD_WATCH 的请求数据; 请求头中的路径为前缀 (可为空)
+typedef struct {
+    uint64_t epoch;                // 上次订阅得到的纪元, 0 表示新订阅
+    uint64_t since_seq;            // 已收到的最后一个事件序号 (新订阅时忽略, 只接收新事件)
+} watch_request;
+
+// 订阅成功时的响应内容; 之后服务端在该连接上持续推送 watch_event
+typedef struct {
+    uint64_t epoch;                // 服务实例的纪元, 重启后改变, 序号只在同一纪元内有效
+    uint64_t next_seq;             // 下一个将推送的事件序号
+} watch_ack;
+
+// CMD_WATCH 被拒绝时的响应状态, 响应内容为原因文本
+typedef enum {
+    WATCH_REJECT_BUSY = -2,        // 订阅者过多, 稍后以相同参数重试
+    WATCH_REJECT_INVALID_SEQ = -3  // 序号超出当前纪元已分配的范围, 应以纪元0重新订阅并通过 list 同步
+} watch_reject;
+
+typedef enum {
+    WATCH_EVENT_CREATED = 1,           // 新建对象
+    WATCH_EVENT_MODIFIED = 2,          // 整体修改
+    WATCH_EVENT_UPDATED = 3,           // 增量更新
+    WATCH_EVENT_PATCHED = 4,           // 追加或区段写入
+    WATCH_EVENT_DELETED = 5,
+    WATCH_EVENT_RETENTION_EXPIRED = 6, // 已满足最小保留期, 可以删除
+    WATCH_EVENT_EXTERNAL_WRITE = 7,    // 绕过服务对数据目录的写入 (需启用 fanotify)
+    WATCH_EVENT_LOST = 8               // 序号不超过 seq 的事件已丢失, 需用 CMD_LIST 重新同步
+} watch_event_type;
+
+// 推送的事件: watch_event 后紧跟 path_len 字节路径 (无结尾0)
+typedef struct {
+    uint64_t seq;
+    int64_t time;
+    uint32_t type;
+    uint32_t path_len;
+} watch_event;
+
+// 响应头, 其后为 length 字节的响应内容; 同一连接上可继续发送下一个请求
+typedef struct {
+    int status;            // 0 成功, -1 失败
+    size_t length;
+} response_header;
+
+// CMD_PATCH 的数据由若干区段组成, 每个区段头后紧跟 length 字节数据
+// 区段按顺序应用, 偏移不能超过此前的文件末尾 (不产生空洞)
+typedef struct {
+    uint64_t offset;
+    uint64_t length;
+} patch_extent;
+
+// CMD_LIST 的请求数据; 请求头中的路径为前缀 (可为空)
+#define LIST_WITH_METADATA 0x1     // 每条结果附带 list_record
+#define LIST_DEFAULT_LIMIT 256
+#define LIST_MAX_LIMIT 4096
+typedef struct {
+    uint32_t limit;                // 每页最多条目数, 0 表示默认值
+    uint32_t flags;
+    char cursor[MAX_PATH_LEN];     // 上一页返回的游标, 空表示从头开始
+} list_request;
+
+// CMD_LIST 的响应: list_response 和下一页游标 (无结尾0), 随后 count 条结果;
+// 每条为 uint16_t 路径长度 + 路径 (无结尾0), 请求元数据时再跟一个 list_record
+typedef struct {
+    uint32_t count;
+    uint16_t more;                 // 非0表示还有后续页
+    uint16_t cursor_len;
+} list_response;
+
+typedef struct {
+    uint64_t size;
+    int64_t creation_time;
+    int64_t modification_time;
+    uint32_t retention_expired;
+    char checksum[CHECKSUM_SIZE];
+} list_record;
+
+// 文件元数据
+typedef struct {
+    time_t creation_time;
+    time_t modification_time;
+    char checksum[CHECKSUM_SIZE];
+} file_metadata;
+
+// 运行时配置
+extern const char *data_dir;
+extern const char *socket_path;
+
+// 日志函数
+void log_message(const char *level, const char *message, ...);
+
+// 路径与元数据
+char* get_full_path(const char *relative_path);
+const char* relative_path_of(const char *full_path);
+int is_internal_file(const char *relative_path);
+int load_metadata(const char *path, file_metadata *metadata);
+int save_metadata(const char *path, file_metadata *metadata);
+int set_immutable_context(const char *path);
+void calculate_checksum(const char *path, char *checksum, size_t checksum_size);
+int retention_expired(const file_metadata *metadata);
+
+// 文件操作
+int modify_file(const char *path, const char *data, size_t data_len);
+int delete_file(const char *path);
+int remove_file(const char *path);
+int rsync_update(const char *path, const char *source_data, size_t data_len);
+int patch_file(const char *path, const char *data, size_t data_len);
+
+// 串行化同一文件上的变更; 持有时文件内容与 .meta 一致
+pthread_mutex_t *path_lock_of(const char *relative_path);
+
+// 完整收发 (处理短读/短写)
+ssize_t recv_all(int fd, void *buf, size_t len);
+ssize_t send_all(int fd, const void *buf, size_t len);
+int send_response(int fd, int status, const void *body, size_t length);
+
+#endif /* IMMUTABLE_SERVICE_H */
@@ -0,0 +1,795 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+
+#include "immutable_service.h"
+#include "journal.h"
+
+// 日志文件状态
+static int journal_fd = -1;
+static off_t journal_end = 0;
+static uint64_t checkpoint_seq = 0;      // 已完成 (并已确认) 的连续记录的最大序号
+static off_t checkpoint_offset = 0;      // 检查点之后第一条记录的偏移
+static off_t checkpoint_saved = 0;       // 文件头中已落盘的检查点偏移
+static uint64_t journal_generation = 0;  // 日志截断次数, 传送线程据此重新定位
+static uint64_t next_seq = 1;
+static uint64_t committed_seq = 0;       // 备用实例中即已应用序号
+static time_t committed_time = 0;        // 最新已提交记录的操作时间
+static replication_role role = ROLE_PRIMARY;
+static pthread_mutex_t journal_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t journal_cond = PTHREAD_COND_INITIALIZER;
+
+// 传送线程状态 (主实例)
+static char standby_socket_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static int standby_fd = -1;              // 到备用实例的持久连接, 仅传送线程使用
+static pthread_t shipper_thread;
+static int shipper_running = 0;
+static int64_t acked_seq = -1;           // -1 表示尚未与备用实例握手
+static time_t acked_time = 0;            // 最新已确认记录的操作时间
+static time_t last_ack_at = 0;
+static int standby_diverged = 0;         // 备用实例落后于检查点, 已停止传送, 需要重新同步
+
+// 接收状态 (备用实例)
+static uint64_t primary_seq = 0;
+static time_t last_batch_at = 0;
+
+// CRC32 (IEEE 802.3)
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+        }
+        crc_table[i] = c;
+    }
+}
+
+static uint32_t crc32_update(uint32_t crc, const void *buf, size_t len) {
+    const unsigned char *p = buf;
+    pthread_once(&crc_once, crc_init);
+    crc = ~crc;
+    while (len--) {
+        crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static uint32_t record_crc(const journal_record *rec, const char *path, const void *data) {
+    uint32_t crc = crc32_update(0, &rec->seq, offsetof(journal_record, crc) - offsetof(journal_record, seq));
+    crc = crc32_update(crc, path, rec->path_len);
+    return crc32_update(crc, data, rec->data_len);
+}
+
+static uint32_t header_crc(const journal_header *hdr) {
+    return crc32_update(0, &hdr->checkpoint_seq, sizeof(*hdr) - offsetof(journal_header, checkpoint_seq));
+}
+
+static size_t record_size(const journal_record *rec) {
+    return sizeof(journal_record) + rec->path_len + rec->data_len;
+}
+
+// 检查记录头是否合理 (防止损坏的长度字段导致越界)
+static int record_header_valid(const journal_record *rec) {
+    return rec->magic == JOURNAL_MAGIC &&
+           rec->path_len > 0 && rec->path_len < MAX_PATH_LEN &&
+           rec->data_len <= MAX_DATA_SIZE;
+}
+
+static int pread_full(int fd, void *buf, size_t len, off_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, (char *)buf + done, len - done, offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        done += n;
+    }
+    return 0;
+}
+
+static int pwritev_full(int fd, struct iovec *iov, int iovcnt, off_t offset) {
+    while (iovcnt > 0) {
+        ssize_t n = pwritev(fd, iov, iovcnt, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        offset += n;
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+static void set_record_state(off_t offset, journal_state state) {
+    uint32_t value = state;
+    // 状态不需要立即落盘: 崩溃后仍为PENDING的记录会在启动时重做
+    if (pwrite(journal_fd, &value, sizeof(value), offset + offsetof(journal_record, state)) != sizeof(value)) {
+        log_message("ERROR", "无法更新日志记录状态: %s", strerror(errno));
+    }
+}
+
+// 写入检查点并落盘 (调用者持有 journal_lock, 或其他线程尚未启动)
+static int write_header(uint64_t seq, off_t offset) {
+    journal_header hdr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = JOURNAL_HEADER_MAGIC;
+    hdr.checkpoint_seq = seq;
+    hdr.checkpoint_offset = offset;
+    hdr.crc = header_crc(&hdr);
+    if (pwrite(journal_fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || fdatasync(journal_fd) != 0) {
+        log_message("ERROR", "无法写入日志检查点: %s", strerror(errno));
+        return -1;
+    }
+    checkpoint_saved = offset;
+    return 0;
+}
+
+// 推进检查点, 累积足够多时回收空间 (调用者持有 journal_lock)
+// 配置了备用实例时只越过其已确认的记录, 否则越过所有已完成的记录
+static void advance_checkpoint_locked(void) {
+    static int punch_unsupported = 0;
+    uint64_t limit = UINT64_MAX;
+    off_t start = checkpoint_saved;
+    journal_record rec;
+
+    if (standby_socket_path[0] && !standby_diverged) {
+        limit = acked_seq < 0 ? checkpoint_seq : (uint64_t)acked_seq;
+    }
+    while (checkpoint_offset < journal_end) {
+        if (pread_full(journal_fd, &rec, sizeof(rec), checkpoint_offset) != 0) break;
+        if (rec.state == JOURNAL_PENDING || rec.seq > limit) break;
+        checkpoint_seq = rec.seq;
+        checkpoint_offset += record_size(&rec);
+    }
+
+    if (checkpoint_offset == journal_end && journal_end - (off_t)sizeof(journal_header) >= JOURNAL_CHECKPOINT_BYTES) {
+        // 全部记录都已完成: 先落盘检查点再截断, 截断前崩溃时残留的记录在启动时按序号跳过
+        if (write_header(checkpoint_seq, sizeof(journal_header)) != 0) return;
+        if (ftruncate(journal_fd, sizeof(journal_header)) != 0) {
+            log_message("ERROR", "无法截断日志文件: %s", strerror(errno));
+            return;
+        }
+        journal_end = checkpoint_offset = sizeof(journal_header);
+        journal_generation++;
+        log_message("INFO", "日志已截断, 检查点序号 %llu", (unsigned long long)checkpoint_seq);
+        return;
+    }
+
+    // 仍有未完成或未确认的记录: 偏移保持不变, 只释放检查点之前的磁盘块
+    if (checkpoint_offset - checkpoint_saved < JOURNAL_CHECKPOINT_BYTES) return;
+    if (write_header(checkpoint_seq, checkpoint_offset) != 0) return;
+    if (!punch_unsupported &&
+        fallocate(journal_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, start, checkpoint_offset - start) != 0) {
+        punch_unsupported = 1;
+        log_message("WARNING", "文件系统不支持回收日志空间, 日志将在全部记录完成后截断: %s", strerror(errno));
+    }
+}
+
+// 应用一条日志记录到数据目录
+// 与客户端请求一样持有路径锁, 完整性巡检不会看到数据已写入而元数据未更新的状态
+// (备用实例上 execute_mutation 不会持有路径锁, 角色切换在 journal_lock 下进行, 不会死锁)
+static int apply_record(const journal_record *rec, const char *rel_path, const char *data) {
+    pthread_mutex_t *lock = path_lock_of(rel_path);
+    char full_path[MAX_PATH_LEN];
+    int existed;
+    int result = -1;
+
+    snprintf(full_path, sizeof(full_path), "%s", get_full_path(rel_path));
+    pthread_mutex_lock(lock);
+    existed = access(full_path, F_OK) == 0;
+
+    switch (rec->cmd) {
+        case CMD_MODIFY:
+            result = modify_file(full_path, data, rec->data_len);
+            break;
+        case CMD_RSYNC_UPDATE:
+            result = rsync_update(full_path, data, rec->data_len);
+            break;
+        case CMD_PATCH:
+            result = patch_file(full_path, data, rec->data_len);
+            break;
+        case CMD_DELETE:
+            if (!existed) {
+                result = 0; // 幂等: 已删除
+            } else if (role == ROLE_STANDBY) {
+                result = remove_file(full_path); // 保留期已由主实例检查
+            } else {
+                result = delete_file(full_path);
+            }
+            break;
+        default:
+            log_message("ERROR", "日志记录 %llu 含未知命令: %u", (unsigned long long)rec->seq, rec->cmd);
+            pthread_mutex_unlock(lock);
+            return -1;
+    }
+
+    // 备用实例沿用主实例的操作时间, 使保留期计算一致
+    if (result == 0 && role == ROLE_STANDBY && rec->cmd != CMD_DELETE) {
+        file_metadata metadata;
+        load_metadata(full_path, &metadata);
+        if (!existed) metadata.creation_time = rec->timestamp;
+        metadata.modification_time = rec->timestamp;
+        save_metadata(full_path, &metadata);
+    }
+    pthread_mutex_unlock(lock);
+    return result;
+}
+
+int journal_open(const char *dir, replication_role initial_role) {
+    char path[MAX_PATH_LEN];
+    struct stat st;
+    journal_header hdr;
+    off_t offset;
+    char *payload = NULL;
+    size_t redone = 0;
+
+    role = initial_role;
+    snprintf(path, sizeof(path), "%s/%s", dir, JOURNAL_FILE_NAME);
+    journal_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (journal_fd == -1) {
+        log_message("ERROR", "无法打开日志文件 %s: %s", path, strerror(errno));
+        return -1;
+    }
+    if (fstat(journal_fd, &st) != 0) {
+        log_message("ERROR", "无法读取日志文件状态: %s", strerror(errno));
+        return -1;
+    }
+
+    // 新日志 (或创建时中断): 写入初始检查点
+    if (st.st_size < (off_t)sizeof(hdr)) {
+        if (ftruncate(journal_fd, 0) != 0 || write_header(0, sizeof(hdr)) != 0) return -1;
+        st.st_size = sizeof(hdr);
+    }
+    if (pread_full(journal_fd, &hdr, sizeof(hdr), 0) != 0 || hdr.magic != JOURNAL_HEADER_MAGIC ||
+        hdr.crc != header_crc(&hdr) || hdr.checkpoint_offset < sizeof(hdr) ||
+        hdr.checkpoint_offset > (uint64_t)st.st_size) {
+        log_message("ERROR", "日志文件头无效: %s", path);
+        return -1;
+    }
+    checkpoint_seq = hdr.checkpoint_seq;
+    checkpoint_offset = checkpoint_saved = hdr.checkpoint_offset;
+    next_seq = checkpoint_seq + 1;
+    committed_seq = checkpoint_seq;
+    offset = checkpoint_offset;
+
+    payload = malloc(MAX_PATH_LEN + MAX_DATA_SIZE + 1);
+    if (!payload) return -1;
+
+    while (offset + (off_t)sizeof(journal_record) <= st.st_size) {
+        journal_record rec;
+        if (pread_full(journal_fd, &rec, sizeof(rec), offset) != 0 || !record_header_valid(&rec)) break;
+        if (offset + (off_t)record_size(&rec) > st.st_size) break;
+        if (pread_full(journal_fd, payload, rec.path_len + rec.data_len, offset + sizeof(rec)) != 0) break;
+        if (record_crc(&rec, payload, payload + rec.path_len) != rec.crc) break;
+
+        // 已在检查点之前 (截断前崩溃时残留)
+        if (rec.seq <= checkpoint_seq) {
+            offset += record_size(&rec);
+            checkpoint_offset = offset;
+            continue;
+        }
+        if (rec.state == JOURNAL_PENDING) {
+            if (role == ROLE_STANDBY) break; // 主实例会重传
+            char rel_path[MAX_PATH_LEN];
+            memcpy(rel_path, payload, rec.path_len);
+            rel_path[rec.path_len] = '\0';
+            rec.state = apply_record(&rec, rel_path, payload + rec.path_len) == 0 ?
+                        JOURNAL_COMMITTED : JOURNAL_ABORTED;
+            set_record_state(offset, rec.state);
+            redone++;
+        }
+        next_seq = rec.seq + 1;
+        if (rec.state == JOURNAL_COMMITTED) {
+            committed_seq = rec.seq;
+            committed_time = rec.timestamp;
+        } else if (role == ROLE_STANDBY && rec.state == JOURNAL_ABORTED) {
+            committed_seq = rec.seq; // 主实例传来的空操作, 同样视为已应用
+        }
+        offset += record_size(&rec);
+    }
+    free(payload);
+
+    if (offset < st.st_size) {
+        log_message("WARNING", "日志尾部存在 %lld 字节不完整记录, 已截断",
+                   (long long)(st.st_size - offset));
+        if (ftruncate(journal_fd, offset) != 0) {
+            log_message("ERROR", "无法截断日志文件: %s", strerror(errno));
+            return -1;
+        }
+    }
+    journal_end = offset;
+
+    log_message("INFO", "日志已打开: %s, 检查点 %llu, 下一序号 %llu, 已提交 %llu, 重做 %zu 条",
+               path, (unsigned long long)checkpoint_seq, (unsigned long long)next_seq,
+               (unsigned long long)committed_seq, redone);
+    return 0;
+}
+
+void journal_close(void) {
+    replication_stop();
+    if (journal_fd != -1) {
+        fdatasync(journal_fd);
+        close(journal_fd);
+        journal_fd = -1;
+    }
+}
+
+// 在日志末尾写入一条完整记录并落盘 (调用者持有 journal_lock)
+static int write_record_locked(journal_record *rec, const char *path, const void *data, off_t *offset) {
+    struct iovec iov[3] = {
+        { rec, sizeof(*rec) },
+        { (void *)path, rec->path_len },
+        { (void *)data, rec->data_len }
+    };
+
+    if (pwritev_full(journal_fd, iov, 3, journal_end) != 0 || fdatasync(journal_fd) != 0) {
+        log_message("ERROR", "写入日志失败: %s", strerror(errno));
+        if (ftruncate(journal_fd, journal_end) != 0) {
+            log_message("ERROR", "无法回滚日志文件: %s", strerror(errno));
+        }
+        return -1;
+    }
+    *offset = journal_end;
+    journal_end += record_size(rec);
+    return 0;
+}
+
+int journal_append(command_type cmd, const char *path, const void *data, size_t data_len,
+                   journal_txn *txn) {
+    journal_record rec;
+    int ret;
+
+    if (journal_fd == -1) return -1;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.magic = JOURNAL_MAGIC;
+    rec.state = JOURNAL_PENDING;
+    rec.timestamp = time(NULL);
+    rec.cmd = cmd;
+    rec.path_len = strlen(path);
+    rec.data_len = data ? data_len : 0;
+
+    pthread_mutex_lock(&journal_lock);
+    rec.seq = next_seq;
+    rec.crc = record_crc(&rec, path, data);
+    ret = write_record_locked(&rec, path, data, &txn->offset);
+    if (ret == 0) {
+        txn->seq = next_seq++;
+    }
+    pthread_mutex_unlock(&journal_lock);
+    return ret;
+}
+
+void journal_finish(const journal_txn *txn, int success) {
+    set_record_state(txn->offset, success ? JOURNAL_COMMITTED : JOURNAL_ABORTED);
+
+    pthread_mutex_lock(&journal_lock);
+    if (success && txn->seq > committed_seq) {
+        committed_seq = txn->seq;
+        committed_time = time(NULL);
+    }
+    advance_checkpoint_locked();
+    pthread_cond_signal(&journal_cond);
+    pthread_mutex_unlock(&journal_lock);
+}
+
+// 查找第一条序号大于 seq 的记录的偏移 (从检查点开始)
+// 需要的记录已被检查点回收时返回-1
+static off_t find_offset_after(uint64_t seq) {
+    off_t offset;
+    off_t end;
+    uint64_t base_seq;
+    journal_record rec;
+
+    pthread_mutex_lock(&journal_lock);
+    end = journal_end;
+    offset = checkpoint_offset;
+    base_seq = checkpoint_seq;
+    pthread_mutex_unlock(&journal_lock);
+
+    if (seq < base_seq) {
+        log_message("ERROR", "备用实例需要的序号 %llu 之后的记录已被检查点 %llu 回收, 停止复制, 需重新同步备用实例",
+                   (unsigned long long)seq, (unsigned long long)base_seq);
+        return -1;
+    }
+
+    while (offset < end) {
+        if (pread_full(journal_fd, &rec, sizeof(rec), offset) != 0) break;
+        if (rec.seq > seq) break;
+        offset += record_size(&rec);
+    }
+    return offset;
+}
+
+// 连接备用实例; 连接保持到出错为止, 备用实例按本进程的凭据认证一次
+static int connect_standby(void) {
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (fd == -1) return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, standby_socket_path, sizeof(addr.sun_path)); // 长度已在启动时检查
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 向备用实例发送一个批次 (batch 为空时仅获取其已应用序号)
+static int send_batch(const void *batch, size_t len, repl_ack *ack) {
+    request_header req;
+    response_header resp;
+
+    if (standby_fd == -1) {
+        standby_fd = connect_standby();
+        if (standby_fd == -1) return -1;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.cmd = CMD_REPLICATE;
+    strncpy(req.path, JOURNAL_FILE_NAME, sizeof(req.path) - 1);
+    req.data_len = len;
+
+    if (send_all(standby_fd, &req, sizeof(req)) == sizeof(req) &&
+        (len == 0 || send_all(standby_fd, batch, len) == (ssize_t)len) &&
+        recv_all(standby_fd, &resp, sizeof(resp)) == sizeof(resp) &&
+        resp.length == sizeof(*ack) &&
+        recv_all(standby_fd, ack, sizeof(*ack)) == sizeof(*ack)) {
+        return 0;
+    }
+
+    // 连接已不可用 (备用实例重启或拒绝), 下次重新连接
+    close(standby_fd);
+    standby_fd = -1;
+    return -1;
+}
+
+static void *shipper_main(void *arg) {
+    char *batch = NULL;
+    off_t offset = 0;
+    uint64_t generation;
+    int idle = 0;
+    (void)arg;
+
+    batch = malloc(REPL_MAX_BATCH_BYTES);
+    if (!batch) {
+        log_message("ERROR", "日志传送线程无法分配批次缓冲区");
+        return NULL;
+    }
+    pthread_mutex_lock(&journal_lock);
+    generation = journal_generation;
+    pthread_mutex_unlock(&journal_lock);
+
+    while (1) {
+        repl_batch_header *bh = (repl_batch_header *)batch;
+        size_t used = sizeof(*bh);
+        uint64_t last_seq = 0;
+        time_t last_time = 0;
+        off_t cursor;
+        off_t end;
+        repl_ack ack;
+
+        pthread_mutex_lock(&journal_lock);
+        if (idle && shipper_running) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += REPL_BATCH_INTERVAL_MS * 1000000L;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+            deadline.tv_nsec %= 1000000000L;
+            pthread_cond_timedwait(&journal_cond, &journal_lock, &deadline);
+        }
+        end = journal_end;
+        if (generation != journal_generation) {
+            // 日志已截断: 截断前的记录均已确认, 从检查点继续
+            generation = journal_generation;
+            offset = checkpoint_offset;
+        }
+        memset(bh, 0, sizeof(*bh));
+        bh->primary_seq = committed_seq;
+        pthread_mutex_unlock(&journal_lock);
+        if (!shipper_running) break;
+
+        // 握手: 获取备用实例的已应用序号并定位
+        if (acked_seq < 0) {
+            if (send_batch(NULL, 0, &ack) != 0) {
+                idle = 0;
+                sleep(REPL_RETRY_INTERVAL_SEC);
+                continue;
+            }
+            pthread_mutex_lock(&journal_lock);
+            acked_seq = ack.applied_seq;
+            last_ack_at = time(NULL);
+            pthread_mutex_unlock(&journal_lock);
+            offset = find_offset_after(ack.applied_seq);
+            if (offset < 0) break;
+            log_message("INFO", "已连接备用实例 %s, 其已应用序号 %llu",
+                       standby_socket_path, (unsigned long long)ack.applied_seq);
+        }
+
+        // 组装批次: 只包含已完成的连续记录; 失败的记录作为不含数据的空操作传送,
+        // 使备用实例看到的序号保持连续
+        cursor = offset;
+        while (cursor < end) {
+            journal_record rec;
+            size_t size;
+
+            if (pread_full(journal_fd, &rec, sizeof(rec), cursor) != 0) break;
+            if (rec.state == JOURNAL_PENDING) break;
+            size = record_size(&rec);
+            if (rec.state == JOURNAL_ABORTED) {
+                char *path = batch + used + sizeof(rec);
+                if (bh->count > 0 && used + sizeof(rec) + rec.path_len > REPL_BATCH_BYTES) break;
+                if (pread_full(journal_fd, path, rec.path_len, cursor + sizeof(rec)) != 0) break;
+                rec.data_len = 0;
+                rec.crc = record_crc(&rec, path, NULL);
+                memcpy(batch + used, &rec, sizeof(rec));
+                used += sizeof(rec) + rec.path_len;
+                bh->count++;
+                last_seq = rec.seq;
+                last_time = rec.timestamp;
+                cursor += size;
+                continue;
+            }
+            if (bh->count > 0 && used + size > REPL_BATCH_BYTES) break;
+            if (pread_full(journal_fd, batch + used, size, cursor) != 0) break;
+            used += size;
+            bh->count++;
+            last_seq = rec.seq;
+            last_time = rec.timestamp;
+            cursor += size;
+        }
+
+        if (bh->count == 0) {
+            idle = cursor == offset;
+            offset = cursor;
+            continue;
+        }
+        idle = 0;
+
+        if (send_batch(batch, used, &ack) != 0) {
+            log_message("WARNING", "无法向备用实例 %s 发送日志批次, 稍后重试", standby_socket_path);
+            pthread_mutex_lock(&journal_lock);
+            acked_seq = -1;
+            pthread_mutex_unlock(&journal_lock);
+            sleep(REPL_RETRY_INTERVAL_SEC);
+            continue;
+        }
+
+        pthread_mutex_lock(&journal_lock);
+        acked_seq = ack.applied_seq;
+        last_ack_at = time(NULL);
+        if (ack.applied_seq == last_seq) acked_time = last_time;
+        advance_checkpoint_locked();
+        pthread_mutex_unlock(&journal_lock);
+
+        if (ack.applied_seq == last_seq) {
+            offset = cursor;
+        } else {
+            // 备用实例未能完整应用, 稍后从其已应用位置重传
+            log_message("WARNING", "备用实例未能应用完整批次 (状态 %d), 已应用序号 %llu, 批次末尾 %llu",
+                       ack.status, (unsigned long long)ack.applied_seq, (unsigned long long)last_seq);
+            sleep(REPL_RETRY_INTERVAL_SEC);
+            offset = find_offset_after(ack.applied_seq);
+            if (offset < 0) break;
+        }
+    }
+
+    // 备用实例无法再通过日志追上: 不再重试, 检查点也不再为其保留记录
+    if (shipper_running) {
+        pthread_mutex_lock(&journal_lock);
+        standby_diverged = 1;
+        pthread_mutex_unlock(&journal_lock);
+    }
+    if (standby_fd != -1) {
+        close(standby_fd);
+        standby_fd = -1;
+    }
+
+    free(batch);
+    return NULL;
+}
+
+int replication_start(const char *standby_socket) {
+    if (strlen(standby_socket) >= sizeof(standby_socket_path)) {
+        log_message("ERROR", "备用实例socket路径过长: %s", standby_socket);
+        return -1;
+    }
+    memcpy(standby_socket_path, standby_socket, strlen(standby_socket) + 1);
+    shipper_running = 1;
+    if (pthread_create(&shipper_thread, NULL, shipper_main, NULL) != 0) {
+        log_message("ERROR", "无法创建日志传送线程");
+        shipper_running = 0;
+        return -1;
+    }
+    log_message("INFO", "日志传送已启动, 备用实例: %s", standby_socket_path);
+    return 0;
+}
+
+void replication_stop(void) {
+    if (!shipper_running) return;
+    pthread_mutex_lock(&journal_lock);
+    shipper_running = 0;
+    pthread_cond_signal(&journal_cond);
+    pthread_mutex_unlock(&journal_lock);
+    pthread_join(shipper_thread, NULL);
+}
+
+int replication_apply_batch(const void *batch, size_t len, repl_ack *ack) {
+    const char *p = batch;
+    const char *end = p + len;
+    repl_batch_header bh;
+    int status = 0;
+
+    memset(ack, 0, sizeof(*ack));
+    pthread_mutex_lock(&journal_lock);
+
+    if (role != ROLE_STANDBY) {
+        log_message("WARNING", "非备用实例拒绝复制批次");
+        status = -1;
+        goto out;
+    }
+    last_batch_at = time(NULL);
+    if (len == 0) goto out; // 握手
+    if (len < sizeof(bh)) {
+        status = -1;
+        goto out;
+    }
+    memcpy(&bh, p, sizeof(bh));
+    p += sizeof(bh);
+    if (bh.primary_seq > primary_seq) primary_seq = bh.primary_seq;
+
+    for (uint32_t i = 0; i < bh.count; i++) {
+        journal_record rec;
+        char rel_path[MAX_PATH_LEN];
+        const char *data;
+        off_t offset;
+
+        if ((size_t)(end - p) < sizeof(rec)) { status = -1; break; }
+        memcpy(&rec, p, sizeof(rec));
+        if (!record_header_valid(&rec) || (size_t)(end - p) < record_size(&rec) ||
+            record_crc(&rec, p + sizeof(rec), p + sizeof(rec) + rec.path_len) != rec.crc) {
+            log_message("ERROR", "复制批次中的记录校验失败");
+            status = -1;
+            break;
+        }
+        memcpy(rel_path, p + sizeof(rec), rec.path_len);
+        rel_path[rec.path_len] = '\0';
+        data = p + sizeof(rec) + rec.path_len;
+        p += record_size(&rec);
+
+        if (rec.seq <= committed_seq) continue; // 已应用, 幂等跳过
+        if (rec.seq != committed_seq + 1) break; // 序号缺口, 等待重传
+
+        // 主实例上失败的操作: 只记录序号, 不应用
+        if (rec.state == JOURNAL_ABORTED) {
+            if (rec.data_len != 0 || write_record_locked(&rec, rel_path, data, &offset) != 0) {
+                status = -1;
+                break;
+            }
+            committed_seq = rec.seq;
+            next_seq = rec.seq + 1;
+            continue;
+        }
+
+        // 原样写入本地日志, 提升后可无缝继续
+        rec.state = JOURNAL_PENDING;
+        if (write_record_locked(&rec, rel_path, data, &offset) != 0) {
+            status = -1;
+            break;
+        }
+        if (apply_record(&rec, rel_path, data) != 0) {
+            log_message("ERROR", "无法应用日志记录 %llu: %s", (unsigned long long)rec.seq, rel_path);
+            journal_end = offset;
+            if (ftruncate(journal_fd, offset) != 0) {
+                log_message("ERROR", "无法回滚日志文件: %s", strerror(errno));
+            }
+            status = -1;
+            break;
+        }
+        set_record_state(offset, JOURNAL_COMMITTED);
+        committed_seq = rec.seq;
+        committed_time = rec.timestamp;
+        next_seq = rec.seq + 1;
+    }
+
+    advance_checkpoint_locked();
+
+out:
+    ack->applied_seq = committed_seq;
+    ack->status = status;
+    pthread_mutex_unlock(&journal_lock);
+    return status;
+}
+
+replication_role replication_get_role(void) {
+    return role;
+}
+
+int replication_status(char *buffer, size_t buffer_size) {
+    time_t now = time(NULL);
+
+    pthread_mutex_lock(&journal_lock);
+    if (role == ROLE_STANDBY) {
+        uint64_t behind = primary_seq > committed_seq ? primary_seq - committed_seq : 0;
+        snprintf(buffer, buffer_size,
+                "角色: 备用实例\n"
+                "已应用序号: %llu\n"
+                "检查点序号: %llu\n"
+                "主实例序号: %llu\n"
+                "复制延迟: %llu 条记录\n"
+                "距上次接收: %ld 秒\n",
+                (unsigned long long)committed_seq,
+                (unsigned long long)checkpoint_seq,
+                (unsigned long long)primary_seq,
+                (unsigned long long)behind,
+                last_batch_at ? (long)(now - last_batch_at) : -1L);
+    } else if (!shipper_running) {
+        snprintf(buffer, buffer_size,
+                "角色: 主实例\n"
+                "最新序号: %llu\n"
+                "已提交序号: %llu\n"
+                "检查点序号: %llu\n"
+                "备用实例: 未配置\n",
+                (unsigned long long)(next_seq - 1),
+                (unsigned long long)committed_seq,
+                (unsigned long long)checkpoint_seq);
+    } else {
+        uint64_t acked = acked_seq < 0 ? 0 : (uint64_t)acked_seq;
+        uint64_t behind = committed_seq > acked ? committed_seq - acked : 0;
+        snprintf(buffer, buffer_size,
+                "角色: 主实例\n"
+                "最新序号: %llu\n"
+                "已提交序号: %llu\n"
+                "检查点序号: %llu\n"
+                "备用实例: %s (%s)\n"
+                "备用已确认序号: %llu\n"
+                "复制延迟: %llu 条记录, %ld 秒\n",
+                (unsigned long long)(next_seq - 1),
+                (unsigned long long)committed_seq,
+                (unsigned long long)checkpoint_seq,
+                standby_socket_path,
+                standby_diverged ? "已停止: 落后于检查点, 需重新同步" : acked_seq < 0 ? "未连接" : "已连接",
+                (unsigned long long)acked,
+                (unsigned long long)behind,
+                behind ? (long)(committed_time - (acked_time ? acked_time : last_ack_at)) : 0L);
+    }
+    pthread_mutex_unlock(&journal_lock);
+    return 0;
+}
+
+int replication_promote(void) {
+    int ret = -1;
+
+    pthread_mutex_lock(&journal_lock);
+    if (role == ROLE_STANDBY) {
+        role = ROLE_PRIMARY;
+        ret = 0;
+        log_message("INFO", "备用实例已提升为主实例, 已应用序号 %llu", (unsigned long long)committed_seq);
+    } else {
+        log_message("WARNING", "提升失败: 当前已是主实例");
+    }
+    pthread_mutex_unlock(&journal_lock);
+    return ret;
+}
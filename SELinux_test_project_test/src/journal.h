@@ -0,0 +1,110 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "immutable_service.h"
+
+#define JOURNAL_FILE_NAME ".journal"
+#define JOURNAL_MAGIC 0x4c4e524aU            // "JRNL"
+#define JOURNAL_HEADER_MAGIC 0x504b434aU     // "JCKP"
+#define JOURNAL_CHECKPOINT_BYTES (16 * 1024 * 1024) // 检查点之前累积到此大小时回收空间
+#define REPL_BATCH_BYTES (1024 * 1024)       // 单批次目标大小 1MB
+#define REPL_MAX_BATCH_BYTES (REPL_BATCH_BYTES + MAX_DATA_SIZE + MAX_PATH_LEN + 4096)
+#define REPL_BATCH_INTERVAL_MS 200           // 无新记录时的最长等待
+#define REPL_RETRY_INTERVAL_SEC 2            // 备用实例不可达时的重试间隔
+
+// 日志记录状态 (不计入CRC, 可原地更新)
+typedef enum {
+    JOURNAL_PENDING = 0,     // 已写入, 操作尚未完成
+    JOURNAL_COMMITTED = 1,   // 操作成功, 可复制
+    JOURNAL_ABORTED = 2      // 操作失败, 只作为不含数据的空操作复制
+} journal_state;
+
+// 日志文件头 (偏移0): 检查点之前的记录均已完成, 且已被备用实例确认 (配置了备用实例时)
+// 启动与重传都从检查点开始, 之前的空间被回收
+typedef struct {
+    uint32_t magic;
+    uint32_t crc;            // 覆盖 checkpoint_seq/checkpoint_offset
+    uint64_t checkpoint_seq;
+    uint64_t checkpoint_offset;
+} journal_header;
+
+// 日志记录头, 其后紧跟 path_len 字节路径和 data_len 字节数据
+typedef struct {
+    uint32_t magic;
+    uint32_t state;
+    uint64_t seq;
+    int64_t timestamp;
+    uint32_t cmd;
+    uint32_t path_len;
+    uint64_t data_len;
+    uint32_t crc;            // 覆盖 seq/timestamp/cmd/path_len/data_len/路径/数据
+    uint32_t reserved;
+} journal_record;
+
+// 复制批次头, 其后紧跟 count 条原始日志记录
+typedef struct {
+    uint64_t primary_seq;    // 主实例最新已提交序号
+    uint32_t count;
+    uint32_t reserved;
+} repl_batch_header;
+
+// 备用实例对批次的应答
+typedef struct {
+    uint64_t applied_seq;
+    int32_t status;          // 0 成功, -1 失败
+    uint32_t reserved;
+} repl_ack;
+
+// 一次写前日志事务
+typedef struct {
+    uint64_t seq;
+    off_t offset;
+} journal_txn;
+
+typedef enum {
+    ROLE_PRIMARY = 0,
+    ROLE_STANDBY = 1
+} replication_role;
+
+/**
+ * 打开 (或创建) 数据目录下的日志文件, 从检查点开始校验并截断损坏的尾部记录
+ * 主实例会重做崩溃时未完成的记录; 备用实例丢弃它们, 等待主实例重传
+ *
+ * @return 成功返回0，失败返回-1
+ */
+int journal_open(const char *dir, replication_role role);
+void journal_close(void);
+
+/**
+ * 写前日志: 在执行变更操作前追加记录并落盘
+ *
+ * @return 成功返回0，失败返回-1 (此时不得执行操作)
+ */
+int journal_append(command_type cmd, const char *path, const void *data, size_t data_len,
+                   journal_txn *txn);
+
+/**
+ * 记录操作结果, 已提交的记录才会被复制到备用实例
+ */
+void journal_finish(const journal_txn *txn, int success);
+
+/**
+ * 启动后台日志传送线程, 批量异步地把已提交记录发往备用实例
+ */
+int replication_start(const char *standby_socket);
+void replication_stop(void);
+
+/**
+ * 备用实例: 幂等地应用一个复制批次 (已应用的序号会被跳过)
+ */
+int replication_apply_batch(const void *batch, size_t len, repl_ack *ack);
+
+replication_role replication_get_role(void);
+int replication_status(char *buffer, size_t buffer_size);
+int replication_promote(void);
+
+#endif /* JOURNAL_H */
@@ -0,0 +1,444 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "immutable_service.h"
+#include "merkle.h"
+
+#define MERKLE_MAGIC "MRKL"
+#define HASH_SIZE SHA256_DIGEST_SIZE
+
+// 辅助文件头, 其后为按堆序排列的 2*capacity-1 个节点:
+// 根为节点0, 节点i的子节点为 2i+1 和 2i+2, 叶子从 capacity-1 开始, 空槽为全零
+typedef struct {
+    char magic[4];
+    uint32_t block_size;
+    uint64_t file_size;
+    uint64_t capacity;                // 叶子槽数, 2的幂
+    char checksum[CHECKSUM_SIZE];     // 节点对应的校验和
+} merkle_header;
+
+#define NODE_OFFSET(i) ((off_t)sizeof(merkle_header) + (off_t)(i) * HASH_SIZE)
+
+static int pread_full(int fd, void *buf, size_t len, off_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, (char *)buf + done, len - done, offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        done += n;
+    }
+    return 0;
+}
+
+static int pwrite_full(int fd, const void *buf, size_t len, off_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pwrite(fd, (const char *)buf + done, len - done, offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        done += n;
+    }
+    return 0;
+}
+
+static size_t leaf_count(uint64_t size) {
+    return (size + MERKLE_BLOCK_SIZE - 1) / MERKLE_BLOCK_SIZE;
+}
+
+static uint64_t capacity_for(size_t leaves) {
+    uint64_t capacity = 1;
+    while (capacity < leaves) capacity <<= 1;
+    return capacity;
+}
+
+// 叶子、内部节点和最终校验和使用不同的前缀字节, 互不混淆
+static void leaf_begin(sha256_ctx *ctx) {
+    static const unsigned char tag = 0x00;
+    sha256_init(ctx);
+    sha256_update(ctx, &tag, 1);
+}
+
+static void hash_node(const unsigned char *left, const unsigned char *right, unsigned char *out) {
+    static const unsigned char tag = 0x01;
+    sha256_ctx ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, &tag, 1);
+    sha256_update(&ctx, left, HASH_SIZE);
+    sha256_update(&ctx, right, HASH_SIZE);
+    sha256_final(&ctx, out);
+}
+
+// 校验和 = H(0x02 || 根 || 文件大小), 使末尾的零字节也能区分
+static void format_checksum(const unsigned char *root, uint64_t size, char *checksum, size_t checksum_size) {
+    static const unsigned char tag = 0x02;
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    unsigned char size_le[8];
+    char hex[SHA256_HEX_SIZE];
+    sha256_ctx ctx;
+
+    for (int i = 0; i < 8; i++) size_le[i] = (unsigned char)(size >> (8 * i));
+    sha256_init(&ctx);
+    sha256_update(&ctx, &tag, 1);
+    sha256_update(&ctx, root, HASH_SIZE);
+    sha256_update(&ctx, size_le, sizeof(size_le));
+    sha256_final(&ctx, digest);
+    sha256_hex(digest, hex);
+    snprintf(checksum, checksum_size, "%s%s", MERKLE_PREFIX, hex);
+}
+
+static void sidecar_path(const char *path, char *out, size_t out_size) {
+    snprintf(out, out_size, "%s%s", path, MERKLE_SUFFIX);
+}
+
+// 由叶子构建完整的树
+static unsigned char *build_tree(const unsigned char *leaves, size_t count, uint64_t capacity) {
+    unsigned char *nodes = calloc(2 * capacity - 1, HASH_SIZE);
+    if (!nodes) return NULL;
+
+    memcpy(nodes + (capacity - 1) * HASH_SIZE, leaves, count * HASH_SIZE);
+    for (uint64_t i = capacity - 1; i-- > 0; ) {
+        hash_node(nodes + (2 * i + 1) * HASH_SIZE, nodes + (2 * i + 2) * HASH_SIZE,
+                  nodes + i * HASH_SIZE);
+    }
+    return nodes;
+}
+
+// 写入完整辅助文件; 最后写文件头, 中途失败时文件头无效, 下次会重建
+static int write_sidecar(const char *path, merkle_header *hdr, const unsigned char *nodes) {
+    char side[MAX_PATH_LEN + sizeof(MERKLE_SUFFIX)];
+    merkle_header invalid;
+    int fd;
+    int ret = -1;
+
+    sidecar_path(path, side, sizeof(side));
+    fd = open(side, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        log_message("ERROR", "无法创建哈希树文件: %s", side);
+        return -1;
+    }
+
+    memset(&invalid, 0, sizeof(invalid));
+    if (pwrite_full(fd, &invalid, sizeof(invalid), 0) == 0 &&
+        pwrite_full(fd, nodes, (2 * hdr->capacity - 1) * HASH_SIZE, NODE_OFFSET(0)) == 0 &&
+        pwrite_full(fd, hdr, sizeof(*hdr), 0) == 0) {
+        ret = 0;
+    }
+    close(fd);
+
+    if (ret == 0) set_immutable_context(side);
+    return ret;
+}
+
+static int builder_add_leaf(merkle_builder *b) {
+    if (b->count == b->allocated) {
+        size_t allocated = b->allocated ? b->allocated * 2 : 64;
+        unsigned char *leaves = realloc(b->leaves, allocated * HASH_SIZE);
+        if (!leaves) return -1;
+        b->leaves = leaves;
+        b->allocated = allocated;
+    }
+    sha256_final(&b->block, b->leaves + b->count * HASH_SIZE);
+    b->count++;
+    b->block_used = 0;
+    return 0;
+}
+
+void merkle_builder_init(merkle_builder *b) {
+    memset(b, 0, sizeof(*b));
+}
+
+int merkle_builder_update(merkle_builder *b, const void *data, size_t len) {
+    const unsigned char *p = data;
+
+    while (len > 0) {
+        size_t take = MERKLE_BLOCK_SIZE - b->block_used;
+        if (take > len) take = len;
+        if (b->block_used == 0) leaf_begin(&b->block);
+        sha256_update(&b->block, p, take);
+        b->block_used += take;
+        b->size += take;
+        p += take;
+        len -= take;
+        if (b->block_used == MERKLE_BLOCK_SIZE && builder_add_leaf(b) != 0) return -1;
+    }
+    return 0;
+}
+
+// 结束最后一个不满的块并构建树, 成功后由调用者释放 nodes
+static int builder_finish(merkle_builder *b, unsigned char **nodes, uint64_t *capacity) {
+    if (b->block_used > 0 && builder_add_leaf(b) != 0) return -1;
+    *capacity = capacity_for(b->count);
+    *nodes = build_tree(b->leaves, b->count, *capacity);
+    return *nodes ? 0 : -1;
+}
+
+int merkle_builder_final(merkle_builder *b, char *checksum, size_t checksum_size) {
+    unsigned char *nodes = NULL;
+    uint64_t capacity;
+    int ret = builder_finish(b, &nodes, &capacity);
+
+    if (ret == 0) format_checksum(nodes, b->size, checksum, checksum_size);
+    free(nodes);
+    free(b->leaves);
+    b->leaves = NULL;
+    return ret;
+}
+
+int merkle_rebuild(const char *path, char *checksum, size_t checksum_size) {
+    merkle_builder b;
+    merkle_header hdr;
+    unsigned char *nodes = NULL;
+    unsigned char *buffer;
+    ssize_t n;
+    int fd;
+    int ret = -1;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        log_message("ERROR", "无法读取文件计算校验和: %s", path);
+        return -1;
+    }
+    buffer = malloc(MERKLE_BLOCK_SIZE);
+    if (!buffer) {
+        close(fd);
+        return -1;
+    }
+
+    merkle_builder_init(&b);
+    while ((n = read(fd, buffer, MERKLE_BLOCK_SIZE)) != 0) {
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 || merkle_builder_update(&b, buffer, n) != 0) break;
+    }
+    close(fd);
+    free(buffer);
+
+    if (n == 0 && builder_finish(&b, &nodes, &hdr.capacity) == 0) {
+        memcpy(hdr.magic, MERKLE_MAGIC, sizeof(hdr.magic));
+        hdr.block_size = MERKLE_BLOCK_SIZE;
+        hdr.file_size = b.size;
+        format_checksum(nodes, b.size, hdr.checksum, sizeof(hdr.checksum));
+        if (write_sidecar(path, &hdr, nodes) == 0) {
+            snprintf(checksum, checksum_size, "%s", hdr.checksum);
+            ret = 0;
+        }
+    } else {
+        log_message("ERROR", "读取文件时出错: %s", path);
+    }
+    free(nodes);
+    free(b.leaves);
+    return ret;
+}
+
+static int compare_block(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// 列出被修改的块 (升序, 去重)
+static uint64_t *dirty_blocks(const merkle_range *ranges, size_t count, size_t *dirty_count) {
+    size_t total = 0, n = 0;
+    uint64_t *blocks;
+
+    for (size_t i = 0; i < count; i++) {
+        if (ranges[i].length == 0) continue;
+        total += (ranges[i].offset + ranges[i].length - 1) / MERKLE_BLOCK_SIZE -
+                 ranges[i].offset / MERKLE_BLOCK_SIZE + 1;
+    }
+    blocks = malloc((total ? total : 1) * sizeof(uint64_t));
+    if (!blocks) return NULL;
+
+    for (size_t i = 0; i < count; i++) {
+        if (ranges[i].length == 0) continue;
+        uint64_t last = (ranges[i].offset + ranges[i].length - 1) / MERKLE_BLOCK_SIZE;
+        for (uint64_t blk = ranges[i].offset / MERKLE_BLOCK_SIZE; blk <= last; blk++) {
+            blocks[n++] = blk;
+        }
+    }
+    qsort(blocks, n, sizeof(uint64_t), compare_block);
+
+    *dirty_count = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (*dirty_count == 0 || blocks[*dirty_count - 1] != blocks[i]) {
+            blocks[(*dirty_count)++] = blocks[i];
+        }
+    }
+    return blocks;
+}
+
+// 读取并哈希一个块
+static int hash_block(int fd, uint64_t block, uint64_t file_size, unsigned char *buffer, unsigned char *out) {
+    uint64_t start = block * MERKLE_BLOCK_SIZE;
+    size_t len = file_size - start < MERKLE_BLOCK_SIZE ? file_size - start : MERKLE_BLOCK_SIZE;
+    sha256_ctx ctx;
+
+    if (pread_full(fd, buffer, len, start) != 0) return -1;
+    leaf_begin(&ctx);
+    sha256_update(&ctx, buffer, len);
+    sha256_final(&ctx, out);
+    return 0;
+}
+
+// 叶子数未超过容量: 原地更新脏叶子及其祖先, 未修改的兄弟节点从辅助文件读取
+// 写到一半崩溃时, 日志重做会以相同的修改范围重写同一组节点
+static int update_in_place(int fd, int side_fd, merkle_header *hdr, uint64_t new_size,
+                           const uint64_t *blocks, size_t dirty, unsigned char *buffer) {
+    uint64_t *idx = malloc(dirty * sizeof(uint64_t));
+    unsigned char (*hash)[HASH_SIZE] = malloc(dirty * HASH_SIZE);
+    size_t count = dirty;
+    int ret = -1;
+
+    if (!idx || !hash) goto out;
+
+    for (size_t k = 0; k < dirty; k++) {
+        idx[k] = hdr->capacity - 1 + blocks[k];
+        if (hash_block(fd, blocks[k], new_size, buffer, hash[k]) != 0 ||
+            pwrite_full(side_fd, hash[k], HASH_SIZE, NODE_OFFSET(idx[k])) != 0) {
+            goto out;
+        }
+    }
+
+    // 逐层向上; 同一层的节点按序号升序, 兄弟节点相邻
+    while (!(count == 1 && idx[0] == 0)) {
+        size_t m = 0;
+        for (size_t k = 0; k < count; k++) {
+            uint64_t i = idx[k];
+            unsigned char sibling[HASH_SIZE];
+            const unsigned char *left, *right;
+
+            if (i % 2 == 1) {
+                left = hash[k];
+                if (k + 1 < count && idx[k + 1] == i + 1) {
+                    right = hash[++k];
+                } else {
+                    if (pread_full(side_fd, sibling, HASH_SIZE, NODE_OFFSET(i + 1)) != 0) goto out;
+                    right = sibling;
+                }
+            } else {
+                if (pread_full(side_fd, sibling, HASH_SIZE, NODE_OFFSET(i - 1)) != 0) goto out;
+                left = sibling;
+                right = hash[k];
+            }
+            idx[m] = (i - 1) / 2;
+            hash_node(left, right, hash[m]);
+            if (pwrite_full(side_fd, hash[m], HASH_SIZE, NODE_OFFSET(idx[m])) != 0) goto out;
+            m++;
+        }
+        count = m;
+    }
+
+    hdr->file_size = new_size;
+    format_checksum(hash[0], new_size, hdr->checksum, sizeof(hdr->checksum));
+    ret = pwrite_full(side_fd, hdr, sizeof(*hdr), 0);
+
+out:
+    free(idx);
+    free(hash);
+    return ret;
+}
+
+// 叶子数超过容量: 读出原有叶子, 只重新哈希脏块, 按翻倍后的容量重建内部节点
+static int grow_tree(const char *path, int fd, int side_fd, merkle_header *hdr, uint64_t new_size,
+                     const uint64_t *blocks, size_t dirty, unsigned char *buffer) {
+    size_t old_count = leaf_count(hdr->file_size);
+    size_t count = leaf_count(new_size);
+    unsigned char *leaves = calloc(count, HASH_SIZE);
+    unsigned char *nodes = NULL;
+    int ret = -1;
+
+    if (!leaves) return -1;
+    if (old_count > 0 &&
+        pread_full(side_fd, leaves, old_count * HASH_SIZE, NODE_OFFSET(hdr->capacity - 1)) != 0) {
+        goto out;
+    }
+    for (size_t k = 0; k < dirty; k++) {
+        if (hash_block(fd, blocks[k], new_size, buffer, leaves + blocks[k] * HASH_SIZE) != 0) goto out;
+    }
+
+    hdr->capacity = capacity_for(count);
+    hdr->file_size = new_size;
+    nodes = build_tree(leaves, count, hdr->capacity);
+    if (!nodes) goto out;
+    format_checksum(nodes, new_size, hdr->checksum, sizeof(hdr->checksum));
+    ret = write_sidecar(path, hdr, nodes);
+
+out:
+    free(leaves);
+    free(nodes);
+    return ret;
+}
+
+int merkle_update(const char *path, const char *expected, const merkle_range *ranges,
+                  size_t count, char *checksum, size_t checksum_size) {
+    char side[MAX_PATH_LEN + sizeof(MERKLE_SUFFIX)];
+    merkle_header hdr;
+    struct stat st;
+    uint64_t new_size;
+    uint64_t *blocks = NULL;
+    unsigned char *buffer = NULL;
+    size_t dirty = 0;
+    int fd = -1, side_fd;
+    int ret = -1;
+
+    sidecar_path(path, side, sizeof(side));
+    side_fd = open(side, O_RDWR | O_CLOEXEC);
+    if (side_fd == -1 || pread_full(side_fd, &hdr, sizeof(hdr), 0) != 0 ||
+        memcmp(hdr.magic, MERKLE_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.block_size != MERKLE_BLOCK_SIZE ||
+        strncmp(hdr.checksum, expected, sizeof(hdr.checksum)) != 0) {
+        goto rebuild;
+    }
+
+    // 只允许原有内容被覆盖或在末尾延长, 大小不符说明有树之外的写入
+    new_size = hdr.file_size;
+    for (size_t i = 0; i < count; i++) {
+        if (ranges[i].offset + ranges[i].length > new_size) {
+            new_size = ranges[i].offset + ranges[i].length;
+        }
+    }
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1 || fstat(fd, &st) != 0 || (uint64_t)st.st_size != new_size) goto rebuild;
+
+    blocks = dirty_blocks(ranges, count, &dirty);
+    buffer = malloc(MERKLE_BLOCK_SIZE);
+    if (!blocks || !buffer) goto rebuild;
+
+    if (leaf_count(new_size) > hdr.capacity) {
+        ret = grow_tree(path, fd, side_fd, &hdr, new_size, blocks, dirty, buffer);
+    } else if (dirty > 0) {
+        ret = update_in_place(fd, side_fd, &hdr, new_size, blocks, dirty, buffer);
+    } else {
+        ret = 0;
+    }
+    if (ret != 0) goto rebuild;
+
+    snprintf(checksum, checksum_size, "%s", hdr.checksum);
+    goto out;
+
+rebuild:
+    if (side_fd != -1) {
+        close(side_fd);
+        side_fd = -1;
+    }
+    log_message("INFO", "哈希树不可用, 完整重建: %s", path);
+    ret = merkle_rebuild(path, checksum, checksum_size);
+
+out:
+    if (fd != -1) close(fd);
+    if (side_fd != -1) close(side_fd);
+    free(blocks);
+    free(buffer);
+    return ret;
+}
+
+void merkle_remove(const char *path) {
+    char side[MAX_PATH_LEN + sizeof(MERKLE_SUFFIX)];
+    sidecar_path(path, side, sizeof(side));
+    unlink(side);
+}
@@ -0,0 +1,62 @@
+#ifndef MERKLE_H
+#define MERKLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "immutable_service.h"
+#include "sha256.h"
+
+#define MERKLE_PREFIX "merkle:"         // 校验和前缀, 与 CHECKSUM_SIZE 等长
+#define MERKLE_SUFFIX ".merkle"         // 保存哈希树的辅助文件
+#define MERKLE_BLOCK_SIZE (64 * 1024)   // 叶子块大小
+
+// 文件中被修改的字节范围
+typedef struct {
+    uint64_t offset;
+    uint64_t length;
+} merkle_range;
+
+// 流式计算 Merkle 校验和 (不写辅助文件), 供完整性巡检使用
+typedef struct {
+    sha256_ctx block;
+    size_t block_used;
+    uint64_t size;
+    unsigned char *leaves;
+    size_t count;
+    size_t allocated;
+} merkle_builder;
+
+void merkle_builder_init(merkle_builder *b);
+int merkle_builder_update(merkle_builder *b, const void *data, size_t len);
+
+/**
+ * 输出校验和并释放内部缓冲区
+ *
+ * @return 成功返回0，失败返回-1
+ */
+int merkle_builder_final(merkle_builder *b, char *checksum, size_t checksum_size);
+
+/**
+ * 完整读取文件, 重建辅助文件并输出校验和
+ *
+ * @return 成功返回0，失败返回-1
+ */
+int merkle_rebuild(const char *path, char *checksum, size_t checksum_size);
+
+/**
+ * 文件的 ranges 已写入后增量更新: 只重新哈希涉及的块及其祖先节点
+ * 辅助文件缺失、与 expected 不一致或文件大小不符时退回 merkle_rebuild
+ *
+ * @param expected 写入前元数据中的校验和
+ * @return 成功返回0，失败返回-1
+ */
+int merkle_update(const char *path, const char *expected, const merkle_range *ranges,
+                  size_t count, char *checksum, size_t checksum_size);
+
+/**
+ * 删除辅助文件 (文件被整体重写或删除时)
+ */
+void merkle_remove(const char *path);
+
+#endif /* MERKLE_H */
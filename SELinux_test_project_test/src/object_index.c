@@ -0,0 +1,411 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "immutable_service.h"
+#include "object_index.h"
+
+#define INDEX_INITIAL_BUCKETS 1024
+#define ORDER_MAX_LEVEL 16               // 跳表层数上限 (每层概率1/4)
+
+typedef struct index_entry {
+    struct index_entry *next;            // 哈希桶链
+    uint64_t hash;
+    unsigned flags;
+    file_metadata metadata;
+    off_t size;                          // 最近一次写入元数据时的文件大小
+    char *path;                          // 存放在 order[] 之后
+    int levels;
+    struct index_entry *order[];         // 按路径排序的跳表后继, 用于分页列举
+} index_entry;
+
+typedef struct {
+    pthread_mutex_t lock;
+    index_entry **buckets;
+    size_t nbuckets;
+    size_t count;
+    index_entry *order_head[ORDER_MAX_LEVEL];
+    int ordered;                         // 跳表是否已建立 (恢复扫描期间只建哈希表)
+    uint32_t rng;
+} index_shard;
+
+static index_shard shards[INDEX_SHARDS];
+
+// FNV-1a
+static uint64_t hash_path(const char *path) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    while (*path) {
+        h ^= (unsigned char)*path++;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static index_shard *shard_of(uint64_t hash) {
+    return &shards[hash % INDEX_SHARDS];
+}
+
+void object_index_init(void) {
+    for (size_t i = 0; i < INDEX_SHARDS; i++) {
+        pthread_mutex_init(&shards[i].lock, NULL);
+        shards[i].nbuckets = INDEX_INITIAL_BUCKETS;
+        shards[i].buckets = calloc(INDEX_INITIAL_BUCKETS, sizeof(index_entry *));
+        shards[i].count = 0;
+        shards[i].rng = 0x9e3779b9u + (uint32_t)i;
+    }
+}
+
+// 负载因子超过1时扩容 (调用者持有分片锁)
+static void shard_grow(index_shard *shard) {
+    size_t nbuckets = shard->nbuckets * 2;
+    index_entry **buckets = calloc(nbuckets, sizeof(index_entry *));
+    if (!buckets) return;
+
+    for (size_t i = 0; i < shard->nbuckets; i++) {
+        index_entry *e = shard->buckets[i];
+        while (e) {
+            index_entry *next = e->next;
+            size_t b = (e->hash / INDEX_SHARDS) % nbuckets;
+            e->next = buckets[b];
+            buckets[b] = e;
+            e = next;
+        }
+    }
+    free(shard->buckets);
+    shard->buckets = buckets;
+    shard->nbuckets = nbuckets;
+}
+
+// 随机层数: 第k层的概率为 4^-(k-1) (调用者持有分片锁)
+static int random_level(index_shard *shard) {
+    uint32_t x = shard->rng;
+    int levels = 1;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    shard->rng = x;
+    while (levels < ORDER_MAX_LEVEL && (x & 3) == 0) {
+        levels++;
+        x >>= 2;
+    }
+    return levels;
+}
+
+// 跳表中第一个路径不小于 key (inclusive) 或大于 key 的条目 (调用者持有分片锁)
+static index_entry *order_seek(index_shard *shard, const char *key, int inclusive) {
+    index_entry **forward = shard->order_head;
+
+    for (int lvl = ORDER_MAX_LEVEL - 1; lvl >= 0; lvl--) {
+        while (forward[lvl]) {
+            int c = strcmp(forward[lvl]->path, key);
+            if (c > 0 || (c == 0 && inclusive)) break;
+            forward = forward[lvl]->order;
+        }
+    }
+    return forward[0];
+}
+
+static void order_insert(index_shard *shard, index_entry *e) {
+    index_entry **forward = shard->order_head;
+    index_entry **update[ORDER_MAX_LEVEL];
+
+    for (int lvl = ORDER_MAX_LEVEL - 1; lvl >= 0; lvl--) {
+        while (forward[lvl] && strcmp(forward[lvl]->path, e->path) < 0) {
+            forward = forward[lvl]->order;
+        }
+        update[lvl] = &forward[lvl];
+    }
+    for (int lvl = 0; lvl < e->levels; lvl++) {
+        e->order[lvl] = *update[lvl];
+        *update[lvl] = e;
+    }
+}
+
+static void order_remove(index_shard *shard, index_entry *e) {
+    index_entry **forward = shard->order_head;
+
+    for (int lvl = ORDER_MAX_LEVEL - 1; lvl >= 0; lvl--) {
+        while (forward[lvl] && forward[lvl] != e && strcmp(forward[lvl]->path, e->path) < 0) {
+            forward = forward[lvl]->order;
+        }
+        if (lvl < e->levels && forward[lvl] == e) {
+            forward[lvl] = e->order[lvl];
+        }
+    }
+}
+
+static int compare_entry_path(const void *a, const void *b) {
+    return strcmp((*(index_entry *const *)a)->path, (*(index_entry *const *)b)->path);
+}
+
+// 排序后按层顺序链接, 一次性建立跳表 (调用者持有分片锁)
+static int order_build(index_shard *shard) {
+    index_entry **sorted = malloc((shard->count ? shard->count : 1) * sizeof(index_entry *));
+    index_entry **tails[ORDER_MAX_LEVEL];
+    size_t n = 0;
+
+    if (!sorted) return -1;
+    for (size_t b = 0; b < shard->nbuckets; b++) {
+        for (index_entry *e = shard->buckets[b]; e; e = e->next) {
+            sorted[n++] = e;
+        }
+    }
+    qsort(sorted, n, sizeof(index_entry *), compare_entry_path);
+
+    for (int lvl = 0; lvl < ORDER_MAX_LEVEL; lvl++) {
+        tails[lvl] = &shard->order_head[lvl];
+    }
+    for (size_t i = 0; i < n; i++) {
+        for (int lvl = 0; lvl < sorted[i]->levels; lvl++) {
+            *tails[lvl] = sorted[i];
+            tails[lvl] = &sorted[i]->order[lvl];
+        }
+    }
+    for (int lvl = 0; lvl < ORDER_MAX_LEVEL; lvl++) {
+        *tails[lvl] = NULL;
+    }
+    free(sorted);
+    shard->ordered = 1;
+    return 0;
+}
+
+// 查找或创建条目 (调用者持有分片锁)
+static index_entry *shard_find(index_shard *shard, const char *path, uint64_t hash, int create) {
+    size_t b = (hash / INDEX_SHARDS) % shard->nbuckets;
+    index_entry *e;
+
+    for (e = shard->buckets[b]; e; e = e->next) {
+        if (e->hash == hash && strcmp(e->path, path) == 0) return e;
+    }
+    if (!create) return NULL;
+
+    int levels = random_level(shard);
+    e = calloc(1, sizeof(index_entry) + levels * sizeof(index_entry *) + strlen(path) + 1);
+    if (!e) return NULL;
+    e->hash = hash;
+    e->levels = levels;
+    e->path = (char *)(e->order + levels);
+    strcpy(e->path, path);
+    e->next = shard->buckets[b];
+    shard->buckets[b] = e;
+    if (shard->ordered) order_insert(shard, e);
+    if (++shard->count > shard->nbuckets) shard_grow(shard);
+    return e;
+}
+
+void object_index_mark(const char *relative_path, unsigned flags) {
+    uint64_t hash = hash_path(relative_path);
+    index_shard *shard = shard_of(hash);
+    index_entry *e;
+
+    pthread_mutex_lock(&shard->lock);
+    e = shard_find(shard, relative_path, hash, 1);
+    if (e) e->flags |= flags;
+    pthread_mutex_unlock(&shard->lock);
+}
+
+void object_index_put(const char *relative_path, const file_metadata *metadata, off_t size) {
+    uint64_t hash = hash_path(relative_path);
+    index_shard *shard = shard_of(hash);
+    index_entry *e;
+
+    pthread_mutex_lock(&shard->lock);
+    e = shard_find(shard, relative_path, hash, 1);
+    if (e) {
+        e->metadata = *metadata;
+        e->size = size;
+        e->flags |= OBJ_SEEN_DATA | OBJ_SEEN_META | OBJ_VALIDATED;
+    }
+    pthread_mutex_unlock(&shard->lock);
+}
+
+void object_index_remove(const char *relative_path) {
+    uint64_t hash = hash_path(relative_path);
+    index_shard *shard = shard_of(hash);
+    index_entry **pp;
+
+    pthread_mutex_lock(&shard->lock);
+    pp = &shard->buckets[(hash / INDEX_SHARDS) % shard->nbuckets];
+    while (*pp) {
+        index_entry *e = *pp;
+        if (e->hash == hash && strcmp(e->path, relative_path) == 0) {
+            *pp = e->next;
+            if (shard->ordered) order_remove(shard, e);
+            free(e);
+            shard->count--;
+            break;
+        }
+        pp = &e->next;
+    }
+    pthread_mutex_unlock(&shard->lock);
+}
+
+int object_index_lookup(const char *relative_path, file_metadata *metadata, off_t *size) {
+    uint64_t hash = hash_path(relative_path);
+    index_shard *shard = shard_of(hash);
+    index_entry *e;
+    char full_path[MAX_PATH_LEN];
+    struct stat st;
+
+    pthread_mutex_lock(&shard->lock);
+    e = shard_find(shard, relative_path, hash, 0);
+    if (e && (e->flags & OBJ_VALIDATED)) {
+        *metadata = e->metadata;
+        if (size) *size = e->size;
+        pthread_mutex_unlock(&shard->lock);
+        return 0;
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    // 惰性验证: 以磁盘为准, 持有路径锁, 不会读到变更中写了一半的 .meta
+    // (否则会按文件状态重建, 覆盖真实的创建时间并重新开始保留期)
+    pthread_mutex_t *lock = path_lock_of(relative_path);
+    pthread_mutex_lock(lock);
+    pthread_mutex_lock(&shard->lock);
+    e = shard_find(shard, relative_path, hash, 0);
+    if (e && (e->flags & OBJ_VALIDATED)) {
+        // 等待路径锁期间已由变更或其他查询验证
+        *metadata = e->metadata;
+        if (size) *size = e->size;
+        pthread_mutex_unlock(&shard->lock);
+        pthread_mutex_unlock(lock);
+        return 0;
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    snprintf(full_path, sizeof(full_path), "%s", get_full_path(relative_path));
+    if (stat(full_path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        object_index_remove(relative_path);
+        pthread_mutex_unlock(lock);
+        return -1;
+    }
+    if (size) *size = st.st_size;
+
+    if (load_metadata(full_path, metadata) != 0) {
+        // 元数据缺失或不完整: 按文件状态重建 (取较晚的时间, 保留期只会更长)
+        metadata->creation_time = st.st_ctime > st.st_mtime ? st.st_ctime : st.st_mtime;
+        metadata->modification_time = st.st_mtime;
+        calculate_checksum(full_path, metadata->checksum, sizeof(metadata->checksum));
+        log_message("WARNING", "文件 %s 的元数据缺失或不完整, 已根据文件状态重建", full_path);
+        save_metadata(full_path, metadata); // 同时写入索引
+        pthread_mutex_unlock(lock);
+        return 0;
+    }
+
+    object_index_put(relative_path, metadata, st.st_size);
+    pthread_mutex_unlock(lock);
+    return 0;
+}
+
+// 在持锁状态下复制符合条件的路径, 然后在不持锁的情况下回调
+static void shard_visit(size_t shard_no, int incomplete_only, object_index_visitor visitor, void *arg) {
+    index_shard *shard = &shards[shard_no];
+    char **paths = NULL;
+    unsigned *flags = NULL;
+    size_t n = 0, cap = 0;
+
+    pthread_mutex_lock(&shard->lock);
+    for (size_t b = 0; b < shard->nbuckets; b++) {
+        for (index_entry *e = shard->buckets[b]; e; e = e->next) {
+            unsigned pair = e->flags & (OBJ_SEEN_DATA | OBJ_SEEN_META);
+            if (incomplete_only &&
+                ((e->flags & OBJ_VALIDATED) || pair == (OBJ_SEEN_DATA | OBJ_SEEN_META))) continue;
+            if (n == cap) {
+                size_t new_cap = cap ? cap * 2 : 64;
+                char **np = realloc(paths, new_cap * sizeof(char *));
+                unsigned *nf = realloc(flags, new_cap * sizeof(unsigned));
+                if (np) paths = np;
+                if (nf) flags = nf;
+                if (!np || !nf) break;
+                cap = new_cap;
+            }
+            paths[n] = strdup(e->path);
+            flags[n] = e->flags;
+            if (paths[n]) n++;
+        }
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    for (size_t i = 0; i < n; i++) {
+        visitor(paths[i], flags[i], arg);
+        free(paths[i]);
+    }
+    free(paths);
+    free(flags);
+}
+
+void object_index_for_each_incomplete(size_t shard, object_index_visitor visitor, void *arg) {
+    // 只复制不成对的条目, 正常情况下极少
+    shard_visit(shard, 1, visitor, arg);
+}
+
+void object_index_for_each(size_t shard, object_index_visitor visitor, void *arg) {
+    shard_visit(shard, 0, visitor, arg);
+}
+
+void object_index_build_order(size_t shard_no) {
+    index_shard *shard = &shards[shard_no];
+
+    pthread_mutex_lock(&shard->lock);
+    if (!shard->ordered) order_build(shard);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+size_t object_index_list(const char *prefix, const char *after, size_t limit, char **paths) {
+    size_t prefix_len = strlen(prefix);
+    size_t n = 0;
+    // 起点: 游标与前缀中较大者
+    int from_cursor = after[0] != '\0' && strcmp(after, prefix) >= 0;
+    const char *key = from_cursor ? after : prefix;
+
+    if (limit == 0) return 0;
+
+    // 各分片有序, 依次合并到有序的结果数组中, 只保留最小的 limit 个
+    for (size_t i = 0; i < INDEX_SHARDS; i++) {
+        index_shard *shard = &shards[i];
+
+        pthread_mutex_lock(&shard->lock);
+        if (!shard->ordered && order_build(shard) != 0) {
+            pthread_mutex_unlock(&shard->lock);
+            log_message("ERROR", "内存不足, 无法列举索引分片 %zu", i);
+            continue;
+        }
+        for (index_entry *e = order_seek(shard, key, !from_cursor); e; e = e->order[0]) {
+            size_t lo = 0, hi = n;
+            char *copy;
+
+            if (strncmp(e->path, prefix, prefix_len) != 0) break;
+            if (n == limit && strcmp(e->path, paths[n - 1]) > 0) break;
+            // 仅有孤立 .meta 的条目 (恢复扫描尚未清理) 不是对象
+            if (!(e->flags & (OBJ_SEEN_DATA | OBJ_VALIDATED))) continue;
+
+            copy = strdup(e->path);
+            if (!copy) break;
+            while (lo < hi) {
+                size_t mid = (lo + hi) / 2;
+                if (strcmp(paths[mid], copy) < 0) lo = mid + 1; else hi = mid;
+            }
+            if (n == limit) free(paths[--n]);
+            memmove(&paths[lo + 1], &paths[lo], (n - lo) * sizeof(char *));
+            paths[lo] = copy;
+            n++;
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+    return n;
+}
+
+size_t object_index_count(void) {
+    size_t total = 0;
+    for (size_t i = 0; i < INDEX_SHARDS; i++) {
+        pthread_mutex_lock(&shards[i].lock);
+        total += shards[i].count;
+        pthread_mutex_unlock(&shards[i].lock);
+    }
+    return total;
+}
@@ -0,0 +1,69 @@
+#ifndef OBJECT_INDEX_H
+#define OBJECT_INDEX_H
+
+#include <stddef.h>
+
+#include "immutable_service.h"
+
+#define INDEX_SHARDS 64
+
+// 条目标志
+#define OBJ_SEEN_DATA 0x1   // 扫描发现数据文件
+#define OBJ_SEEN_META 0x2   // 扫描发现 .meta 文件
+#define OBJ_VALIDATED 0x4   // 元数据已加载并与磁盘核对
+
+typedef void (*object_index_visitor)(const char *relative_path, unsigned flags, void *arg);
+
+/**
+ * 初始化内存对象索引 (按路径哈希分片, 每片独立加锁)
+ */
+void object_index_init(void);
+
+/**
+ * 记录扫描时发现的数据文件或 .meta 文件, 不加载元数据
+ */
+void object_index_mark(const char *relative_path, unsigned flags);
+
+/**
+ * 写入已验证的元数据和文件大小 (save_metadata 之后调用)
+ */
+void object_index_put(const char *relative_path, const file_metadata *metadata, off_t size);
+
+void object_index_remove(const char *relative_path);
+
+/**
+ * 查询对象元数据 (size 可为NULL); 条目未验证或不存在时持有路径锁从磁盘加载,
+ * .meta 缺失或不完整时根据文件状态重建 (路径锁可重入, 调用者可已持有)
+ *
+ * @return 对象存在返回0，否则返回-1
+ */
+int object_index_lookup(const char *relative_path, file_metadata *metadata, off_t *size);
+
+/**
+ * 遍历一个分片中未验证且数据/元数据不成对的条目
+ * 回调在不持有分片锁的情况下执行
+ */
+void object_index_for_each_incomplete(size_t shard, object_index_visitor visitor, void *arg);
+
+/**
+ * 遍历一个分片中的全部条目, 回调在不持有分片锁的情况下执行
+ */
+void object_index_for_each(size_t shard, object_index_visitor visitor, void *arg);
+
+/**
+ * 为一个分片建立按路径排序的跳表 (恢复扫描结束时调用; 之后的插入/删除增量维护)
+ */
+void object_index_build_order(size_t shard);
+
+/**
+ * 按路径顺序列举以 prefix 开头且大于 after 的前 limit 个对象 (after 为空表示从头开始)
+ * 各分片维护按路径排序的跳表, 无需扫描整个索引; 跳表尚未建立的分片在此建立
+ *
+ * @param paths 至少 limit 个元素, 返回的路径由调用者释放
+ * @return 返回的路径数
+ */
+size_t object_index_list(const char *prefix, const char *after, size_t limit, char **paths);
+
+size_t object_index_count(void);
+
+#endif /* OBJECT_INDEX_H */
@@ -0,0 +1,376 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "immutable_service.h"
+#include "object_index.h"
+#include "recovery.h"
+#include "merkle.h"
+
+#define META_SUFFIX ".meta"
+#define SOURCE_SUFFIX ".source"
+
+// getdents64 返回的目录项
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// 扫描任务: names 为空时表示待读取的目录, 否则为一批目录项
+// 目录项格式: [d_type][名称]\0 ...
+typedef struct recovery_task {
+    struct recovery_task *next;
+    char *dir;
+    char *names;
+    size_t count;
+} recovery_task;
+
+static const char *scan_root;
+static time_t started_at;
+static struct timespec started_mono;
+static int thread_count;
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static recovery_task *queue_head = NULL;
+static size_t pending_tasks = 0;      // 已入队或正在处理的任务
+
+static atomic_int running = 0;
+static atomic_int workers_left = 0;
+static atomic_size_t next_shard = 0;
+static atomic_size_t next_order_shard = 0;
+static atomic_size_t entries_scanned = 0;
+static atomic_size_t orphans_removed = 0;
+static atomic_size_t metadata_rebuilt = 0;
+static long elapsed_ms = -1;
+
+static int has_suffix(const char *name, size_t len, const char *suffix) {
+    size_t slen = strlen(suffix);
+    return len > slen && memcmp(name + len - slen, suffix, slen) == 0;
+}
+
+// 拼接路径, 超出缓冲区时返回-1 (截断的路径可能指向另一个文件, 不能使用)
+static int join_path(char *out, size_t size, const char *dir, const char *name) {
+    int n = dir[0] ? snprintf(out, size, "%s/%s", dir, name) : snprintf(out, size, "%s", name);
+    return n >= 0 && (size_t)n < size ? 0 : -1;
+}
+
+static void push_task(char *dir, char *names, size_t count) {
+    recovery_task *task = malloc(sizeof(recovery_task));
+    if (!task) {
+        log_message("ERROR", "恢复任务分配失败: %s", dir);
+        free(dir);
+        free(names);
+        return;
+    }
+    task->dir = dir;
+    task->names = names;
+    task->count = count;
+
+    pthread_mutex_lock(&queue_lock);
+    task->next = queue_head;
+    queue_head = task;
+    pending_tasks++;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+}
+
+// 用 getdents64 批量读取目录, 每个缓冲区的目录项作为一个任务交给其他线程
+static void read_directory(const char *rel_dir) {
+    char path[MAX_PATH_LEN];
+    char *buf;
+    int fd;
+
+    if ((rel_dir[0] ? join_path(path, sizeof(path), scan_root, rel_dir)
+                    : join_path(path, sizeof(path), "", scan_root)) != 0) {
+        log_message("WARNING", "恢复时跳过过长的目录路径: %s", rel_dir);
+        return;
+    }
+    fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        log_message("ERROR", "恢复时无法打开目录 %s: %s", path, strerror(errno));
+        return;
+    }
+
+    buf = malloc(RECOVERY_DIRENT_BUF_SIZE);
+    if (!buf) {
+        close(fd);
+        return;
+    }
+
+    while (1) {
+        long nread = syscall(SYS_getdents64, fd, buf, RECOVERY_DIRENT_BUF_SIZE);
+        char *names, *out;
+        size_t count = 0;
+
+        if (nread < 0) {
+            log_message("ERROR", "getdents64 失败 %s: %s", path, strerror(errno));
+            break;
+        }
+        if (nread == 0) break;
+
+        // 名称总长度不超过读取的字节数
+        names = malloc(nread);
+        if (!names) break;
+        out = names;
+        for (long pos = 0; pos < nread; ) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + pos);
+            unsigned char type = d->d_type;
+            pos += d->d_reclen;
+
+            if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0) continue;
+            if (type == DT_UNKNOWN) {
+                struct stat st;
+                if (fstatat(fd, d->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+                type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+            }
+            *out++ = (char)type;
+            out = stpcpy(out, d->d_name) + 1;
+            count++;
+        }
+        if (count == 0) {
+            free(names);
+            continue;
+        }
+        push_task(strdup(rel_dir), names, count);
+    }
+
+    free(buf);
+    close(fd);
+}
+
+static void process_batch(const recovery_task *task) {
+    const char *p = task->names;
+    char rel[MAX_PATH_LEN];
+
+    for (size_t i = 0; i < task->count; i++) {
+        unsigned char type = (unsigned char)*p++;
+        const char *name = p;
+        size_t len = strlen(name);
+        p += len + 1;
+
+        if (join_path(rel, sizeof(rel), task->dir, name) != 0) {
+            log_message("WARNING", "恢复时跳过过长的路径: %s/%s", task->dir, name);
+            continue;
+        }
+        if (type == DT_DIR) {
+            push_task(strdup(rel), NULL, 0);
+            continue;
+        }
+        if (type != DT_REG || is_internal_file(rel)) continue;
+        atomic_fetch_add(&entries_scanned, 1);
+
+        if (has_suffix(name, len, SOURCE_SUFFIX)) {
+            // rsync_update() 中断后遗留的临时文件; 只清理启动前创建的, 避免干扰正在进行的更新
+            struct stat st;
+            char full[MAX_PATH_LEN * 2];
+            if (join_path(full, sizeof(full), scan_root, rel) != 0) continue;
+            if (stat(full, &st) == 0 && st.st_mtime < started_at && unlink(full) == 0) {
+                log_message("INFO", "已清理孤立的临时文件: %s", full);
+                atomic_fetch_add(&orphans_removed, 1);
+            }
+        } else if (has_suffix(name, len, MERKLE_SUFFIX)) {
+            // 哈希树辅助文件不是对象; 数据文件已不存在时清理
+            char base[MAX_PATH_LEN];
+            char full[MAX_PATH_LEN * 2];
+            char sidecar[MAX_PATH_LEN * 2];
+            size_t base_len = strlen(rel) - strlen(MERKLE_SUFFIX);
+            memcpy(base, rel, base_len);
+            base[base_len] = '\0';
+            if (join_path(full, sizeof(full), scan_root, base) != 0 ||
+                join_path(sidecar, sizeof(sidecar), scan_root, rel) != 0) {
+                log_message("WARNING", "恢复时跳过过长的路径: %s", rel);
+                continue;
+            }
+            if (access(full, F_OK) != 0 && unlink(sidecar) == 0) {
+                log_message("INFO", "已清理孤立的哈希树文件: %s", sidecar);
+                atomic_fetch_add(&orphans_removed, 1);
+            }
+        } else if (has_suffix(name, len, META_SUFFIX)) {
+            rel[strlen(rel) - strlen(META_SUFFIX)] = '\0';
+            object_index_mark(rel, OBJ_SEEN_META);
+        } else {
+            object_index_mark(rel, OBJ_SEEN_DATA);
+        }
+    }
+}
+
+// 处理数据文件与 .meta 不成对的条目
+static void reconcile_entry(const char *rel, unsigned flags, void *arg) {
+    char full[MAX_PATH_LEN * 2];
+    char meta[MAX_PATH_LEN * 2 + sizeof(META_SUFFIX)];
+    file_metadata metadata;
+    (void)arg;
+
+    if (join_path(full, sizeof(full), scan_root, rel) != 0 ||
+        snprintf(meta, sizeof(meta), "%s%s", full, META_SUFFIX) >= (int)sizeof(meta)) {
+        log_message("WARNING", "恢复时跳过过长的路径: %s", rel);
+        return;
+    }
+
+    if (!(flags & OBJ_SEEN_DATA) && access(full, F_OK) != 0) {
+        // 数据文件已不存在: 删除孤立的 .meta
+        if (unlink(meta) == 0) {
+            log_message("INFO", "已清理孤立的元数据文件: %s", meta);
+            atomic_fetch_add(&orphans_removed, 1);
+        }
+        object_index_remove(rel);
+        return;
+    }
+
+    if (access(meta, F_OK) != 0) {
+        atomic_fetch_add(&metadata_rebuilt, 1);
+    }
+    object_index_lookup(rel, &metadata, NULL); // 缺失时重建 .meta
+}
+
+static void finish_recovery(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    pthread_mutex_lock(&queue_lock);
+    elapsed_ms = (now.tv_sec - started_mono.tv_sec) * 1000L +
+                 (now.tv_nsec - started_mono.tv_nsec) / 1000000L;
+    pthread_mutex_unlock(&queue_lock);
+    atomic_store(&running, 0);
+
+    log_message("INFO", "启动恢复完成: 扫描 %zu 个条目, 对象 %zu 个, 清理孤立文件 %zu 个, 重建元数据 %zu 个, "
+               "耗时 %ld ms (%d 线程)",
+               atomic_load(&entries_scanned), object_index_count(),
+               atomic_load(&orphans_removed), atomic_load(&metadata_rebuilt),
+               elapsed_ms, thread_count);
+}
+
+static void *recovery_worker(void *arg) {
+    size_t shard;
+    (void)arg;
+
+    // 阶段一: 并行扫描
+    while (1) {
+        recovery_task *task;
+
+        pthread_mutex_lock(&queue_lock);
+        while (!queue_head && pending_tasks > 0) {
+            pthread_cond_wait(&queue_cond, &queue_lock);
+        }
+        if (!queue_head) {
+            pthread_mutex_unlock(&queue_lock);
+            break;
+        }
+        task = queue_head;
+        queue_head = task->next;
+        pthread_mutex_unlock(&queue_lock);
+
+        if (task->names) {
+            process_batch(task);
+        } else {
+            read_directory(task->dir);
+        }
+        free(task->dir);
+        free(task->names);
+        free(task);
+
+        pthread_mutex_lock(&queue_lock);
+        if (--pending_tasks == 0) pthread_cond_broadcast(&queue_cond);
+        pthread_mutex_unlock(&queue_lock);
+    }
+
+    // 阶段二: 按索引分片并行核对
+    while ((shard = atomic_fetch_add(&next_shard, 1)) < INDEX_SHARDS) {
+        object_index_for_each_incomplete(shard, reconcile_entry, NULL);
+    }
+
+    if (atomic_fetch_sub(&workers_left, 1) == 1) {
+        finish_recovery();
+    }
+
+    // 阶段三: 为分片建立列举用的有序跳表; 索引此时已可用, 列举请求会按需建立尚未完成的分片
+    while ((shard = atomic_fetch_add(&next_order_shard, 1)) < INDEX_SHARDS) {
+        object_index_build_order(shard);
+    }
+    return NULL;
+}
+
+int recovery_start(const char *dir, int threads) {
+    pthread_attr_t attr;
+    int started = 0;
+
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+
+    scan_root = dir;
+    started_at = time(NULL);
+    clock_gettime(CLOCK_MONOTONIC, &started_mono);
+    thread_count = threads;
+    atomic_store(&running, 1);
+    atomic_store(&workers_left, threads);
+
+    push_task(strdup(""), NULL, 0);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (int i = 0; i < threads; i++) {
+        pthread_t tid;
+        if (pthread_create(&tid, &attr, recovery_worker, NULL) != 0) {
+            log_message("ERROR", "无法创建恢复线程: %s", strerror(errno));
+            break;
+        }
+        started++;
+    }
+    pthread_attr_destroy(&attr);
+
+    if (started == 0) {
+        atomic_store(&running, 0);
+        return -1;
+    }
+    if (started < threads) {
+        // 未能创建的线程视为已完成
+        thread_count = started;
+        if (atomic_fetch_sub(&workers_left, threads - started) == threads - started) {
+            finish_recovery();
+        }
+    }
+
+    log_message("INFO", "启动恢复已开始: %s (%d 线程)", dir, thread_count);
+    return 0;
+}
+
+int recovery_in_progress(void) {
+    return atomic_load(&running);
+}
+
+int recovery_status(char *buffer, size_t buffer_size) {
+    long ms;
+
+    pthread_mutex_lock(&queue_lock);
+    ms = elapsed_ms;
+    pthread_mutex_unlock(&queue_lock);
+
+    snprintf(buffer, buffer_size,
+            "启动恢复: %s\n"
+            "已扫描条目: %zu\n"
+            "对象数: %zu\n"
+            "清理孤立文件: %zu\n"
+            "重建元数据: %zu\n"
+            "恢复耗时: %ld ms (%d 线程)\n",
+            recovery_in_progress() ? "进行中" : "已完成",
+            atomic_load(&entries_scanned), object_index_count(),
+            atomic_load(&orphans_removed), atomic_load(&metadata_rebuilt),
+            ms, thread_count);
+    return 0;
+}
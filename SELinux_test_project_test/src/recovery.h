@@ -0,0 +1,26 @@
+#ifndef RECOVERY_H
+#define RECOVERY_H
+
+#include <stddef.h>
+
+#define RECOVERY_DIRENT_BUF_SIZE (256 * 1024)   // 每次 getdents64 读取的缓冲区
+
+/**
+ * 启动后台恢复: 多线程用 getdents64 扫描数据目录, 重建对象索引,
+ * 清理孤立的 .source 临时文件和 .meta 文件, 并为缺失元数据的文件重建 .meta
+ * 函数立即返回, 服务可以在扫描期间通过惰性验证的索引提供读取
+ *
+ * @param dir 数据目录
+ * @param threads 工作线程数, 0 表示使用在线CPU数
+ * @return 成功返回0，失败返回-1
+ */
+int recovery_start(const char *dir, int threads);
+
+int recovery_in_progress(void);
+
+/**
+ * 输出恢复进度与耗时
+ */
+int recovery_status(char *buffer, size_t buffer_size);
+
+#endif /* RECOVERY_H */
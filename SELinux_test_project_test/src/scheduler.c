@@ -0,0 +1,329 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "immutable_service.h"
+#include "scheduler.h"
+
+// 每个客户端在各类别中的队列
+typedef struct {
+    sched_job *head;
+    sched_job *tail;
+    long deficit;
+    int active;                       // 是否在类别的轮转环中
+    struct sched_client *ring_next;
+} client_queue;
+
+typedef struct sched_client {
+    struct sched_client *next;
+    uid_t uid;
+    size_t inflight_bytes;            // 排队 + 处理中
+    size_t jobs;
+    client_queue q[CLASS_COUNT];
+} sched_client;
+
+typedef struct {
+    sched_client *ring_head;          // 有排队请求的客户端
+    sched_client *ring_tail;
+    size_t queued;
+    size_t limit;
+    long quantum;
+    // 统计
+    size_t completed;
+    size_t rejected;
+    double wait_total_ms;
+    double wait_max_ms;
+    double service_total_ms;
+    double service_max_ms;
+} class_state;
+
+static pthread_mutex_t sched_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sched_cond = PTHREAD_COND_INITIALIZER;
+static sched_client *clients = NULL;
+static class_state classes[CLASS_COUNT] = {
+    { NULL, NULL, 0, SCHED_QUEUE_SMALL, SCHED_BASE_COST, 0, 0, 0, 0, 0, 0 },
+    { NULL, NULL, 0, SCHED_QUEUE_LARGE, SCHED_LARGE_QUANTUM, 0, 0, 0, 0, 0, 0 }
+};
+static size_t inflight_bytes = 0;
+static int worker_count = 0;
+static int workers_running = 0;
+static int stopping = 0;
+static int large_running = 0;
+static int large_limit = 1;
+static sched_handler job_handler = NULL;
+
+static double elapsed_ms(const struct timespec *from, const struct timespec *to) {
+    return (to->tv_sec - from->tv_sec) * 1000.0 + (to->tv_nsec - from->tv_nsec) / 1e6;
+}
+
+static sched_client *find_client(uid_t uid, int create) {
+    sched_client *c;
+
+    for (c = clients; c; c = c->next) {
+        if (c->uid == uid) return c;
+    }
+    if (!create) return NULL;
+
+    c = calloc(1, sizeof(sched_client));
+    if (!c) return NULL;
+    c->uid = uid;
+    c->next = clients;
+    clients = c;
+    return c;
+}
+
+static void release_client(sched_client *c) {
+    sched_client **pp;
+
+    if (c->jobs > 0) return;
+    for (pp = &clients; *pp; pp = &(*pp)->next) {
+        if (*pp == c) {
+            *pp = c->next;
+            free(c);
+            return;
+        }
+    }
+}
+
+static void ring_append(class_state *cs, sched_client *c, request_class cls) {
+    c->q[cls].ring_next = NULL;
+    if (cs->ring_tail) {
+        cs->ring_tail->q[cls].ring_next = c;
+    } else {
+        cs->ring_head = c;
+    }
+    cs->ring_tail = c;
+}
+
+static sched_client *ring_pop(class_state *cs, request_class cls) {
+    sched_client *c = cs->ring_head;
+    cs->ring_head = c->q[cls].ring_next;
+    if (!cs->ring_head) cs->ring_tail = NULL;
+    c->q[cls].ring_next = NULL;
+    return c;
+}
+
+// 差额轮转: 客户端配额不足时补充并移到环尾
+static sched_job *dequeue(request_class cls) {
+    class_state *cs = &classes[cls];
+
+    while (cs->ring_head) {
+        sched_client *c = cs->ring_head;
+        client_queue *q = &c->q[cls];
+        sched_job *job = q->head;
+
+        if (q->deficit >= (long)job->cost) {
+            q->deficit -= job->cost;
+            q->head = job->next;
+            if (!q->head) {
+                q->tail = NULL;
+                q->deficit = 0;
+                q->active = 0;
+                ring_pop(cs, cls);
+            }
+            cs->queued--;
+            return job;
+        }
+        q->deficit += cs->quantum;
+        ring_pop(cs, cls);
+        ring_append(cs, c, cls);
+    }
+    return NULL;
+}
+
+int scheduler_submit(sched_job *job) {
+    class_state *cs = &classes[job->cls];
+    sched_client *c;
+    const char *reason = NULL;
+
+    job->cost = SCHED_BASE_COST + (job->cls == CLASS_LARGE ? job->req.data_len : 0);
+    job->next = NULL;
+    clock_gettime(CLOCK_MONOTONIC, &job->enqueued);
+
+    pthread_mutex_lock(&sched_lock);
+    c = find_client(job->uid, 1);
+    if (!c) {
+        reason = "内存不足";
+    } else if (cs->queued >= cs->limit) {
+        reason = "队列已满";
+    } else if (inflight_bytes + job->cost > SCHED_MAX_INFLIGHT_BYTES) {
+        reason = "在途数据超过全局上限";
+    } else if (c->inflight_bytes + job->cost > SCHED_CLIENT_MAX_BYTES) {
+        reason = "在途数据超过客户端上限";
+    }
+
+    if (reason) {
+        cs->rejected++;
+        if (c) release_client(c);
+        pthread_mutex_unlock(&sched_lock);
+        log_message("WARNING", "拒绝请求 (uid %d, pid %d, 命令 %d): %s",
+                   (int)job->uid, (int)job->pid, job->req.cmd, reason);
+        return -1;
+    }
+
+    c->inflight_bytes += job->cost;
+    c->jobs++;
+    inflight_bytes += job->cost;
+
+    client_queue *q = &c->q[job->cls];
+    if (q->tail) {
+        q->tail->next = job;
+    } else {
+        q->head = job;
+    }
+    q->tail = job;
+    if (!q->active) {
+        q->active = 1;
+        ring_append(cs, c, job->cls);
+    }
+    cs->queued++;
+
+    pthread_cond_signal(&sched_cond);
+    pthread_mutex_unlock(&sched_lock);
+    return 0;
+}
+
+static void complete_job(sched_job *job, const struct timespec *finished) {
+    class_state *cs = &classes[job->cls];
+    double wait = elapsed_ms(&job->enqueued, &job->started);
+    double service = elapsed_ms(&job->started, finished);
+    sched_client *c;
+
+    pthread_mutex_lock(&sched_lock);
+    cs->completed++;
+    cs->wait_total_ms += wait;
+    cs->service_total_ms += service;
+    if (wait > cs->wait_max_ms) cs->wait_max_ms = wait;
+    if (service > cs->service_max_ms) cs->service_max_ms = service;
+
+    inflight_bytes -= job->cost;
+    if (job->cls == CLASS_LARGE) large_running--;
+    c = find_client(job->uid, 0);
+    if (c) {
+        c->inflight_bytes -= job->cost;
+        c->jobs--;
+        release_client(c);
+    }
+    pthread_cond_broadcast(&sched_cond);
+    pthread_mutex_unlock(&sched_lock);
+
+    log_message("INFO", "命令 %d 完成 (uid %d): 排队 %.2f ms, 处理 %.2f ms",
+               job->req.cmd, (int)job->uid, wait, service);
+}
+
+static void *worker_main(void *arg) {
+    (void)arg;
+
+    while (1) {
+        sched_job *job = NULL;
+        struct timespec finished;
+
+        pthread_mutex_lock(&sched_lock);
+        while (1) {
+            // 小请求严格优先; 大请求受并发上限约束
+            job = dequeue(CLASS_SMALL);
+            if (job) break;
+            if (large_running < large_limit) {
+                job = dequeue(CLASS_LARGE);
+                if (job) {
+                    large_running++;
+                    break;
+                }
+            }
+            if (stopping) break; // 已没有可取的请求, 剩余的大请求由正在处理大请求的线程取走
+            pthread_cond_wait(&sched_cond, &sched_lock);
+        }
+        if (!job) {
+            workers_running--;
+            pthread_cond_broadcast(&sched_cond);
+            pthread_mutex_unlock(&sched_lock);
+            return NULL;
+        }
+        pthread_mutex_unlock(&sched_lock);
+
+        clock_gettime(CLOCK_MONOTONIC, &job->started);
+        job_handler(job);
+        clock_gettime(CLOCK_MONOTONIC, &finished);
+
+        complete_job(job, &finished);
+        free(job);
+    }
+    return NULL;
+}
+
+int scheduler_start(int workers, sched_handler handler) {
+    pthread_attr_t attr;
+
+    if (workers <= 0) workers = SCHED_DEFAULT_WORKERS;
+    if (workers < SCHED_MIN_WORKERS) {
+        log_message("WARNING", "工作线程数至少为 %d, 已调整", SCHED_MIN_WORKERS);
+        workers = SCHED_MIN_WORKERS;
+    }
+    job_handler = handler;
+    large_limit = workers - 1;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (int i = 0; i < workers; i++) {
+        pthread_t tid;
+        if (pthread_create(&tid, &attr, worker_main, NULL) != 0) {
+            log_message("ERROR", "无法创建工作线程: %s", strerror(errno));
+            break;
+        }
+        worker_count++;
+    }
+    pthread_attr_destroy(&attr);
+    pthread_mutex_lock(&sched_lock);
+    workers_running = worker_count;
+    pthread_mutex_unlock(&sched_lock);
+
+    if (worker_count == 0) return -1;
+    if (worker_count < SCHED_MIN_WORKERS) {
+        log_message("WARNING", "只创建了 %d 个工作线程, 小请求可能排在大请求之后", worker_count);
+    }
+    large_limit = worker_count > 1 ? worker_count - 1 : 1;
+    log_message("INFO", "请求调度已启动: %d 工作线程, 大请求并发上限 %d", worker_count, large_limit);
+    return 0;
+}
+
+void scheduler_stop(void) {
+    pthread_mutex_lock(&sched_lock);
+    stopping = 1;
+    pthread_cond_broadcast(&sched_cond);
+    while (workers_running > 0) {
+        pthread_cond_wait(&sched_cond, &sched_lock);
+    }
+    pthread_mutex_unlock(&sched_lock);
+}
+
+int scheduler_status(char *buffer, size_t buffer_size) {
+    static const char *names[CLASS_COUNT] = { "小请求", "大请求" };
+    size_t used;
+    int n;
+
+    pthread_mutex_lock(&sched_lock);
+    n = snprintf(buffer, buffer_size,
+                "调度: %d 工作线程, 排队 %zu/%zu 小请求, %zu/%zu 大请求, 在途 %.1f MB\n",
+                worker_count,
+                classes[CLASS_SMALL].queued, classes[CLASS_SMALL].limit,
+                classes[CLASS_LARGE].queued, classes[CLASS_LARGE].limit,
+                inflight_bytes / (1024.0 * 1024.0));
+    used = n < 0 ? 0 : (size_t)n;
+
+    for (int i = 0; i < CLASS_COUNT && used < buffer_size; i++) {
+        const class_state *cs = &classes[i];
+        double done = cs->completed ? (double)cs->completed : 1.0;
+        n = snprintf(buffer + used, buffer_size - used,
+                    "%s: 完成 %zu, 拒绝 %zu, 排队 平均 %.2f ms/最大 %.2f ms, 处理 平均 %.2f ms/最大 %.2f ms\n",
+                    names[i], cs->completed, cs->rejected,
+                    cs->wait_total_ms / done, cs->wait_max_ms,
+                    cs->service_total_ms / done, cs->service_max_ms);
+        used += n < 0 ? 0 : (size_t)n;
+    }
+    pthread_mutex_unlock(&sched_lock);
+    return 0;
+}
@@ -0,0 +1,68 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "immutable_service.h"
+
+#define SCHED_DEFAULT_WORKERS 4
+#define SCHED_MIN_WORKERS 2                         // 至少一个线程留给小请求
+#define SCHED_QUEUE_SMALL 256                       // 小请求队列上限 (条)
+#define SCHED_QUEUE_LARGE 32                        // 大请求队列上限 (条)
+#define SCHED_MAX_INFLIGHT_BYTES (128 * 1024 * 1024) // 排队+处理中的声明数据总量上限
+#define SCHED_CLIENT_MAX_BYTES (32 * 1024 * 1024)    // 单个客户端 (uid) 的上限
+#define SCHED_BASE_COST 4096                        // 每个请求的基础开销 (字节)
+#define SCHED_LARGE_QUANTUM (1024 * 1024)           // 大请求按字节轮转的配额
+#define SCHED_HEADER_TIMEOUT_SEC 5                  // 请求头到达后接收其余部分/数据的超时
+
+// 请求类别: 小的元数据操作优先于大数据写入
+typedef enum {
+    CLASS_SMALL = 0,   // 查询、删除、状态等
+    CLASS_LARGE = 1,   // 带数据的修改和增量更新
+    CLASS_COUNT
+} request_class;
+
+struct session;
+
+typedef struct sched_job {
+    struct sched_job *next;
+    struct session *session;          // 请求所在连接的会话
+    request_header req;
+    uid_t uid;
+    pid_t pid;
+    request_class cls;
+    size_t cost;
+    struct timespec enqueued;
+    struct timespec started;
+} sched_job;
+
+typedef void (*sched_handler)(sched_job *job);
+
+/**
+ * 启动工作线程池; 大请求最多占用 workers-1 个线程, 保证小请求始终有线程可用
+ * workers 小于 SCHED_MIN_WORKERS 时按 SCHED_MIN_WORKERS 启动
+ */
+int scheduler_start(int workers, sched_handler handler);
+
+/**
+ * 提交请求: 超过队列长度或在途字节限制时拒绝, 由调用者回复繁忙状态
+ * 同一类别内按客户端 uid 做差额轮转 (DRR), 大请求按字节计费
+ *
+ * @return 已入队返回0，被拒绝返回-1
+ */
+int scheduler_submit(sched_job *job);
+
+/**
+ * 停止工作线程池: 处理完已排队和处理中的请求后工作线程退出, 返回时已没有请求在处理
+ * 调用者须先停止提交新请求
+ */
+void scheduler_stop(void);
+
+/**
+ * 输出队列状态与分类别的排队/处理耗时统计
+ */
+int scheduler_status(char *buffer, size_t buffer_size);
+
+#endif /* SCHEDULER_H */
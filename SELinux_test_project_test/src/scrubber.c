@@ -0,0 +1,430 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#include "immutable_service.h"
+#include "object_index.h"
+#include "recovery.h"
+#include "scrubber.h"
+#include "sha256.h"
+#include "merkle.h"
+
+_Static_assert(INDEX_SHARDS <= 64, "巡检进度位图最多支持64个分片");
+
+#define ALL_SHARDS (INDEX_SHARDS == 64 ? UINT64_MAX : ((1ULL << INDEX_SHARDS) - 1))
+
+typedef struct {
+    char path[MAX_PATH_LEN];
+    char expected[CHECKSUM_SIZE];
+    char actual[CHECKSUM_SIZE];
+    time_t detected;
+} scrub_mismatch;
+
+static char state_path[MAX_PATH_LEN];
+static int scrub_threads = 0;
+static long scrub_rate_mb = 0;
+
+// 巡检进度 (受 scrub_lock 保护)
+static pthread_mutex_t scrub_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t scrub_cond = PTHREAD_COND_INITIALIZER;
+static unsigned long pass_no = 1;
+static time_t pass_started = 0;
+static time_t last_pass_finished = 0;
+static time_t next_pass_at = 0;
+static uint64_t completed_shards = 0;
+static uint64_t claimed_shards = 0;
+static size_t objects_checked = 0;
+static uint64_t bytes_scrubbed = 0;
+static size_t unverifiable = 0;
+static size_t mismatches_total = 0;
+static scrub_mismatch mismatches[SCRUB_MAX_REPORTED];
+static size_t mismatch_count = 0;
+
+// 令牌桶 (字节)
+static pthread_mutex_t bucket_lock = PTHREAD_MUTEX_INITIALIZER;
+static double bucket_tokens = 0;
+static double bucket_rate = 0;
+static struct timespec bucket_refilled;
+
+static void bucket_consume(size_t bytes) {
+    struct timespec now;
+    double wait = 0, burst;
+
+    if (bucket_rate <= 0) return;
+    burst = bucket_rate > SCRUB_CHUNK_SIZE ? bucket_rate : SCRUB_CHUNK_SIZE;
+
+    pthread_mutex_lock(&bucket_lock);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    bucket_tokens += ((now.tv_sec - bucket_refilled.tv_sec) +
+                      (now.tv_nsec - bucket_refilled.tv_nsec) / 1e9) * bucket_rate;
+    if (bucket_tokens > burst) bucket_tokens = burst;
+    bucket_refilled = now;
+    bucket_tokens -= bytes;
+    if (bucket_tokens < 0) wait = -bucket_tokens / bucket_rate;
+    pthread_mutex_unlock(&bucket_lock);
+
+    if (wait > 0) {
+        struct timespec ts = { (time_t)wait, (long)((wait - (time_t)wait) * 1e9) };
+        while (nanosleep(&ts, &ts) != 0 && errno == EINTR);
+    }
+}
+
+// 保存进度 (调用者持有 scrub_lock)
+static void save_state_locked(void) {
+    FILE *fp = fopen(state_path, "w");
+    if (!fp) {
+        log_message("ERROR", "无法保存巡检进度: %s", state_path);
+        return;
+    }
+    fprintf(fp, "pass=%lu\n", pass_no);
+    fprintf(fp, "pass_started=%ld\n", (long)pass_started);
+    fprintf(fp, "completed=%llx\n", (unsigned long long)completed_shards);
+    fprintf(fp, "last_pass_finished=%ld\n", (long)last_pass_finished);
+    fclose(fp);
+}
+
+static void load_state(void) {
+    FILE *fp = fopen(state_path, "r");
+    char line[128];
+
+    if (!fp) return;
+    while (fgets(line, sizeof(line), fp)) {
+        char *key = strtok(line, "=");
+        char *value = strtok(NULL, "\n");
+        if (!key || !value) continue;
+        if (strcmp(key, "pass") == 0) {
+            pass_no = strtoul(value, NULL, 10);
+        } else if (strcmp(key, "pass_started") == 0) {
+            pass_started = atol(value);
+        } else if (strcmp(key, "completed") == 0) {
+            completed_shards = strtoull(value, NULL, 16) & ALL_SHARDS;
+        } else if (strcmp(key, "last_pass_finished") == 0) {
+            last_pass_finished = atol(value);
+        }
+    }
+    fclose(fp);
+
+    if (last_pass_finished && completed_shards == 0) {
+        next_pass_at = last_pass_finished + SCRUB_PASS_INTERVAL_SEC;
+    }
+}
+
+static void record_mismatch(const char *path, const char *expected, const char *actual) {
+    scrub_mismatch *m = NULL;
+
+    log_message("WARNING", "完整性巡检发现校验和不一致: %s (期望 %s, 实际 %s)", path, expected, actual);
+
+    pthread_mutex_lock(&scrub_lock);
+    mismatches_total++;
+    for (size_t i = 0; i < mismatch_count; i++) {
+        if (strcmp(mismatches[i].path, path) == 0) {
+            m = &mismatches[i];
+            break;
+        }
+    }
+    if (!m) {
+        // 已满时覆盖最早的记录
+        if (mismatch_count == SCRUB_MAX_REPORTED) {
+            memmove(&mismatches[0], &mismatches[1], sizeof(scrub_mismatch) * (SCRUB_MAX_REPORTED - 1));
+            mismatch_count--;
+        }
+        m = &mismatches[mismatch_count++];
+    }
+    snprintf(m->path, sizeof(m->path), "%s", path);
+    snprintf(m->expected, sizeof(m->expected), "%s", expected);
+    snprintf(m->actual, sizeof(m->actual), "%s", actual);
+    m->detected = time(NULL);
+    pthread_mutex_unlock(&scrub_lock);
+}
+
+// 以大块顺序读取计算文件哈希, 不污染页缓存
+// merkle 非0时按哈希树计算 (由追加/区段写入维护的文件)
+// throttle 为0时不受限速约束 (持有路径锁时使用, 避免限速等待阻塞该文件上的写入)
+static int hash_file(const char *path, int merkle, int throttle, unsigned char *buffer,
+                     char *checksum, size_t checksum_size) {
+    merkle_builder tree;
+    sha256_ctx ctx;
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    char hex[SHA256_HEX_SIZE];
+    off_t offset = 0;
+    int direct = 1;
+    ssize_t n;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC | O_DIRECT);
+    if (fd == -1 && errno == EINVAL) {
+        direct = 0;
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+    }
+    if (fd == -1) return -1;
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_NOREUSE);
+
+    sha256_init(&ctx);
+    merkle_builder_init(&tree);
+    while ((n = read(fd, buffer, SCRUB_CHUNK_SIZE)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EINVAL && direct) {
+                // 文件系统不支持 O_DIRECT 读取: 改用普通读取并主动丢弃缓存
+                int flags = fcntl(fd, F_GETFL);
+                direct = 0;
+                if (fcntl(fd, F_SETFL, flags & ~O_DIRECT) == 0) continue;
+            }
+            close(fd);
+            free(tree.leaves);
+            return -1;
+        }
+        if (merkle) {
+            merkle_builder_update(&tree, buffer, n);
+        } else {
+            sha256_update(&ctx, buffer, n);
+        }
+        if (!direct) {
+            posix_fadvise(fd, offset, n, POSIX_FADV_DONTNEED);
+        }
+        offset += n;
+        if (throttle) bucket_consume(n);
+    }
+    close(fd);
+
+    if (merkle) {
+        if (merkle_builder_final(&tree, checksum, checksum_size) != 0) return -1;
+    } else {
+        sha256_final(&ctx, digest);
+        sha256_hex(digest, hex);
+        snprintf(checksum, checksum_size, "%s%s", CHECKSUM_PREFIX, hex);
+    }
+
+    pthread_mutex_lock(&scrub_lock);
+    bytes_scrubbed += offset;
+    pthread_mutex_unlock(&scrub_lock);
+    return 0;
+}
+
+static void scrub_object(const char *relative_path, unsigned flags, void *arg) {
+    unsigned char *buffer = arg;
+    char full_path[MAX_PATH_LEN];
+    char actual[CHECKSUM_SIZE];
+    file_metadata metadata, current;
+    (void)flags;
+
+    snprintf(full_path, sizeof(full_path), "%s", get_full_path(relative_path));
+    if (load_metadata(full_path, &metadata) != 0) return; // 由恢复/惰性验证处理
+
+    int merkle = strncmp(metadata.checksum, MERKLE_PREFIX, strlen(MERKLE_PREFIX)) == 0;
+    if (!merkle && strncmp(metadata.checksum, CHECKSUM_PREFIX, strlen(CHECKSUM_PREFIX)) != 0) {
+        pthread_mutex_lock(&scrub_lock);
+        unverifiable++;
+        pthread_mutex_unlock(&scrub_lock);
+        return;
+    }
+
+    if (hash_file(full_path, merkle, 1, buffer, actual, sizeof(actual)) != 0) return; // 文件已删除
+
+    pthread_mutex_lock(&scrub_lock);
+    objects_checked++;
+    pthread_mutex_unlock(&scrub_lock);
+
+    if (strcmp(actual, metadata.checksum) == 0) return;
+
+    // 读取时可能正与写入并发 (数据已写入而 .meta 尚未更新): 持有路径锁重新加载元数据并再校验一次,
+    // 仍不一致才报告; 不一致很少见, 只在此时阻塞该文件上的写入, 且重新校验不限速
+    pthread_mutex_t *lock = path_lock_of(relative_path);
+    int result;
+    pthread_mutex_lock(lock);
+    result = load_metadata(full_path, &current);
+    if (result == 0) {
+        merkle = strncmp(current.checksum, MERKLE_PREFIX, strlen(MERKLE_PREFIX)) == 0;
+        result = hash_file(full_path, merkle, 0, buffer, actual, sizeof(actual));
+    }
+    pthread_mutex_unlock(lock);
+
+    if (result != 0 || strcmp(actual, current.checksum) == 0) return;
+    record_mismatch(relative_path, current.checksum, actual);
+}
+
+// 开始新一轮 (调用者持有 scrub_lock)
+static void begin_pass_locked(void) {
+    completed_shards = 0;
+    claimed_shards = 0;
+    objects_checked = 0;
+    bytes_scrubbed = 0;
+    unverifiable = 0;
+    pass_started = time(NULL);
+    next_pass_at = 0;
+    log_message("INFO", "完整性巡检第 %lu 轮开始", pass_no);
+}
+
+// 所有分片完成 (调用者持有 scrub_lock)
+static void finish_pass_locked(void) {
+    last_pass_finished = time(NULL);
+    log_message("INFO", "完整性巡检第 %lu 轮完成: 校验 %zu 个对象, 读取 %.1f MB, 耗时 %ld 秒, 累计不一致 %zu 个",
+               pass_no, objects_checked, bytes_scrubbed / (1024.0 * 1024.0),
+               (long)(last_pass_finished - pass_started), mismatches_total);
+    pass_no++;
+    completed_shards = 0;
+    next_pass_at = last_pass_finished + SCRUB_PASS_INTERVAL_SEC;
+    save_state_locked();
+}
+
+static void *scrub_worker(void *arg) {
+    unsigned char *buffer = NULL;
+    (void)arg;
+
+    if (posix_memalign((void **)&buffer, SCRUB_DIRECT_ALIGN, SCRUB_CHUNK_SIZE) != 0) {
+        log_message("ERROR", "巡检线程无法分配缓冲区");
+        return NULL;
+    }
+
+    // 等待启动恢复完成, 此时索引已包含所有对象
+    while (recovery_in_progress()) {
+        sleep(1);
+    }
+
+    while (1) {
+        int shard = -1;
+
+        pthread_mutex_lock(&scrub_lock);
+        while (1) {
+            time_t now = time(NULL);
+            if (next_pass_at > now) {
+                struct timespec deadline = { next_pass_at, 0 };
+                pthread_cond_timedwait(&scrub_cond, &scrub_lock, &deadline);
+                continue;
+            }
+            if (pass_started == 0 || next_pass_at) {
+                begin_pass_locked();
+            }
+            for (int i = 0; i < INDEX_SHARDS; i++) {
+                if (!((completed_shards | claimed_shards) & (1ULL << i))) {
+                    shard = i;
+                    break;
+                }
+            }
+            if (shard >= 0) break;
+            // 其余分片正由其他线程处理
+            pthread_cond_wait(&scrub_cond, &scrub_lock);
+        }
+        claimed_shards |= 1ULL << shard;
+        pthread_mutex_unlock(&scrub_lock);
+
+        object_index_for_each(shard, scrub_object, buffer);
+
+        pthread_mutex_lock(&scrub_lock);
+        claimed_shards &= ~(1ULL << shard);
+        completed_shards |= 1ULL << shard;
+        if (completed_shards == ALL_SHARDS) {
+            finish_pass_locked();
+        } else {
+            save_state_locked();
+        }
+        pthread_cond_broadcast(&scrub_cond);
+        pthread_mutex_unlock(&scrub_lock);
+    }
+
+    free(buffer);
+    return NULL;
+}
+
+int scrubber_start(const char *dir, int threads, long rate_mb) {
+    pthread_attr_t attr;
+    int started = 0;
+
+    if (threads <= 0) {
+        log_message("INFO", "完整性巡检已禁用");
+        return 0;
+    }
+
+    snprintf(state_path, sizeof(state_path), "%s/%s", dir, SCRUB_STATE_FILE_NAME);
+    scrub_rate_mb = rate_mb;
+    bucket_rate = rate_mb > 0 ? rate_mb * 1024.0 * 1024.0 : 0;
+    clock_gettime(CLOCK_MONOTONIC, &bucket_refilled);
+    load_state();
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (int i = 0; i < threads; i++) {
+        pthread_t tid;
+        if (pthread_create(&tid, &attr, scrub_worker, NULL) != 0) {
+            log_message("ERROR", "无法创建巡检线程: %s", strerror(errno));
+            break;
+        }
+        started++;
+    }
+    pthread_attr_destroy(&attr);
+    scrub_threads = started;
+
+    if (started == 0) return -1;
+    log_message("INFO", "完整性巡检已启动: %d 线程, 限速 %ld MB/s, 第 %lu 轮已完成 %d 个分片",
+               started, rate_mb, pass_no, __builtin_popcountll(completed_shards));
+    return 0;
+}
+
+void scrubber_trigger(void) {
+    pthread_mutex_lock(&scrub_lock);
+    if (next_pass_at) {
+        next_pass_at = time(NULL);
+        pthread_cond_broadcast(&scrub_cond);
+        log_message("INFO", "已请求立即开始完整性巡检");
+    }
+    pthread_mutex_unlock(&scrub_lock);
+}
+
+int scrubber_report(char *buffer, size_t buffer_size) {
+    time_t now = time(NULL);
+    size_t used;
+    int n;
+
+    pthread_mutex_lock(&scrub_lock);
+    if (scrub_threads == 0) {
+        snprintf(buffer, buffer_size, "完整性巡检: 已禁用\n");
+        pthread_mutex_unlock(&scrub_lock);
+        return 0;
+    }
+
+    if (next_pass_at > now) {
+        n = snprintf(buffer, buffer_size, "完整性巡检: 空闲, %ld 秒后开始第 %lu 轮\n",
+                    (long)(next_pass_at - now), pass_no);
+    } else {
+        n = snprintf(buffer, buffer_size, "完整性巡检: 第 %lu 轮进行中, 已完成分片 %d/%d\n",
+                    pass_no, __builtin_popcountll(completed_shards), INDEX_SHARDS);
+    }
+    used = n < 0 ? 0 : (size_t)n;
+    if (used < buffer_size) {
+        n = snprintf(buffer + used, buffer_size - used,
+                    "本轮已校验对象: %zu, 读取 %.1f MB\n"
+                    "无法校验 (旧格式校验和): %zu\n"
+                    "限速: %ld MB/s, 线程: %d\n"
+                    "累计校验和不一致: %zu\n",
+                    objects_checked, bytes_scrubbed / (1024.0 * 1024.0),
+                    unverifiable, scrub_rate_mb, scrub_threads, mismatches_total);
+        used += n < 0 ? 0 : (size_t)n;
+    }
+
+    // 最近发现的排在前面, 放不下时截断
+    for (size_t i = mismatch_count; i > 0 && used < buffer_size; i--) {
+        const scrub_mismatch *m = &mismatches[i - 1];
+        char when[32];
+        struct tm tm_info;
+
+        localtime_r(&m->detected, &tm_info);
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm_info);
+        n = snprintf(buffer + used, buffer_size - used, "  [%s] %s\n    期望 %s\n    实际 %s\n",
+                    when, m->path, m->expected, m->actual);
+        if (n < 0 || used + n >= buffer_size) {
+            buffer[used] = '\0';
+            break;
+        }
+        used += n;
+    }
+    pthread_mutex_unlock(&scrub_lock);
+    return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef SCRUBBER_H
+#define SCRUBBER_H
+
+#include <stddef.h>
+
+#define SCRUB_STATE_FILE_NAME ".scrub_state"
+#define SCRUB_CHUNK_SIZE (1024 * 1024)          // 每次顺序读取 1MB
+#define SCRUB_DIRECT_ALIGN 4096                 // O_DIRECT 缓冲区对齐
+#define SCRUB_DEFAULT_THREADS 2
+#define SCRUB_DEFAULT_RATE_MB 20                // 默认I/O预算 20MB/s
+#define SCRUB_PASS_INTERVAL_SEC (24 * 3600)     // 每轮巡检间隔
+#define SCRUB_MAX_REPORTED 256                  // 保留的校验失败记录数
+
+/**
+ * 启动后台完整性巡检: 多线程按索引分片遍历对象, 重新计算SHA-256 (或Merkle树) 并与 .meta 中的校验和比较
+ * 读取绕过页缓存 (O_DIRECT, 不支持时退回 posix_fadvise), 总读取速率受令牌桶限制
+ * 每完成一个分片即保存进度, 重启后从未完成的分片继续
+ *
+ * @param dir 数据目录
+ * @param threads 巡检线程数, 0 表示禁用
+ * @param rate_mb 每秒读取预算 (MB), 0 表示不限速
+ * @return 成功返回0，失败返回-1
+ */
+int scrubber_start(const char *dir, int threads, long rate_mb);
+
+/**
+ * 立即开始新一轮巡检 (当前轮进行中时无效果)
+ */
+void scrubber_trigger(void);
+
+/**
+ * 输出巡检进度与校验失败的对象
+ */
+int scrubber_report(char *buffer, size_t buffer_size);
+
+#endif /* SCRUBBER_H */
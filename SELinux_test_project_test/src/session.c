@@ -0,0 +1,104 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <selinux/selinux.h>
+#include <selinux/context.h>
+
+#include "immutable_service.h"
+#include "session.h"
+
+static uid_t allowed_uids[SESSION_MAX_ALLOWED_UIDS];
+static int allowed_uid_count = 0;
+
+int session_allow_uids(const char *uid_list) {
+    char *copy = strdup(uid_list);
+    char *saveptr = NULL;
+    char *token;
+
+    if (!copy) return -1;
+    for (token = strtok_r(copy, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr)) {
+        char *end;
+        long uid = strtol(token, &end, 10);
+        if (*end != '\0' || uid < 0 || allowed_uid_count == SESSION_MAX_ALLOWED_UIDS) {
+            free(copy);
+            return -1;
+        }
+        allowed_uids[allowed_uid_count++] = (uid_t)uid;
+    }
+    free(copy);
+    return 0;
+}
+
+static int uid_allowed(uid_t uid) {
+    for (int i = 0; i < allowed_uid_count; i++) {
+        if (allowed_uids[i] == uid) return 1;
+    }
+    return 0;
+}
+
+// 取SELinux上下文中的type字段
+static int context_type_is(const char *peer_context, const char *type) {
+    context_t context;
+    const char *peer_type;
+    int match = 0;
+
+    if (!peer_context[0]) return 0;
+    context = context_new(peer_context);
+    if (!context) return 0;
+    peer_type = context_type_get(context);
+    match = peer_type && strcmp(peer_type, type) == 0;
+    context_free(context);
+    return match;
+}
+
+session* session_open(int fd) {
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    security_context_t peer_context = NULL;
+    session *s;
+
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0) {
+        log_message("ERROR", "无法获取对端凭据: %s", strerror(errno));
+        return NULL;
+    }
+
+    s = calloc(1, sizeof(session));
+    if (!s) return NULL;
+    s->fd = fd;
+    s->uid = cred.uid;
+    s->gid = cred.gid;
+    s->pid = cred.pid;
+    s->established = time(NULL);
+
+    // SELinux未启用时 getpeercon 失败, 仅按uid授权
+    if (getpeercon(fd, &peer_context) == 0) {
+        snprintf(s->context, sizeof(s->context), "%s", peer_context);
+        freecon(peer_context);
+    }
+
+    if (s->uid == 0 || s->uid == geteuid() || context_type_is(s->context, SERVICE_DOMAIN_TYPE)) {
+        s->allowed = OPS_ADMIN;
+    } else if (uid_allowed(s->uid) || context_type_is(s->context, CLIENT_DOMAIN_TYPE)) {
+        s->allowed = OPS_CLIENT;
+    } else {
+        s->allowed = 0;
+    }
+
+    log_message(s->allowed ? "INFO" : "WARNING",
+               "建立会话: uid %d, gid %d, pid %d, 上下文 %s, 权限 %s",
+               (int)s->uid, (int)s->gid, (int)s->pid,
+               s->context[0] ? s->context : "(无)",
+               s->allowed == OPS_ADMIN ? "管理员" : s->allowed ? "客户端" : "无");
+    return s;
+}
+
+void session_close(session *s) {
+    log_message("INFO", "会话结束: uid %d, pid %d, 处理 %lu 个请求",
+               (int)s->uid, (int)s->pid, s->requests);
+    close(s->fd);
+    free(s);
+}
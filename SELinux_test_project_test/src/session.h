@@ -0,0 +1,64 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <sys/types.h>
+#include <time.h>
+
+#include "immutable_service.h"
+
+#define SESSION_MAX_ALLOWED_UIDS 32
+#define SESSION_CONTEXT_SIZE 256
+
+// SELinux 域 (见 policy/immutable_policy.te)
+#define CLIENT_DOMAIN_TYPE "immutable_client_t"
+#define SERVICE_DOMAIN_TYPE "immutable_service_t"
+
+#define OP_BIT(cmd) (1u << (cmd))
+
+// 普通客户端可执行的命令
+#define OPS_CLIENT (OP_BIT(CMD_MODIFY) | OP_BIT(CMD_DELETE) | OP_BIT(CMD_RSYNC_UPDATE) | \
+                    OP_BIT(CMD_GET_INFO) | OP_BIT(CMD_REPL_STATUS) | OP_BIT(CMD_SCRUB_REPORT) | \
+                    OP_BIT(CMD_APPEND) | OP_BIT(CMD_PATCH) | OP_BIT(CMD_LIST) | \
+                    OP_BIT(CMD_WATCH))
+// 管理员 (root、服务自身用户、服务域) 额外可执行的命令
+#define OPS_ADMIN (OPS_CLIENT | OP_BIT(CMD_REPLICATE) | OP_BIT(CMD_PROMOTE) | OP_BIT(CMD_SCRUB_START))
+
+// 一个连接上的会话, 建立时根据内核提供的对端凭据认证一次
+typedef struct session {
+    int fd;
+    uid_t uid;
+    gid_t gid;
+    pid_t pid;
+    char context[SESSION_CONTEXT_SIZE];   // 对端SELinux上下文, 不可用时为空
+    unsigned allowed;                     // 允许的命令位图
+    time_t established;
+    unsigned long requests;
+    request_header header;                // 正在接收的请求头 (接收线程不阻塞等待)
+    size_t header_len;                    // 已收到的字节数
+} session;
+
+/**
+ * 添加允许执行普通客户端命令的uid (root和服务自身用户总是允许)
+ *
+ * @param uid_list 逗号分隔的uid列表
+ * @return 成功返回0，失败返回-1
+ */
+int session_allow_uids(const char *uid_list);
+
+/**
+ * 为新连接建立会话: 读取 SO_PEERCRED 和 getpeercon, 计算允许的命令
+ *
+ * @return 成功返回会话，失败返回NULL (调用者关闭连接)
+ */
+session* session_open(int fd);
+
+static inline int session_allows(const session *s, command_type cmd) {
+    return cmd > 0 && cmd < 32 && (s->allowed & OP_BIT(cmd)) != 0;
+}
+
+/**
+ * 关闭连接并释放会话
+ */
+void session_close(session *s);
+
+#endif /* SESSION_H */
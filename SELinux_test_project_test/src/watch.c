@@ -0,0 +1,716 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/fanotify.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "immutable_service.h"
+#include "object_index.h"
+#include "recovery.h"
+#include "session.h"
+#include "watch.h"
+
+// 历史环中的一个事件
+typedef struct {
+    uint64_t seq;
+    int64_t time;
+    uint32_t type;
+    char *path;
+} history_entry;
+
+// 一个订阅者; 除 next 外只由推送线程访问
+typedef struct subscriber {
+    struct subscriber *next;           // 等待推送线程接管的订阅 (受 history_lock 保护)
+    session *session;
+    char prefix[MAX_PATH_LEN];
+    size_t prefix_len;
+    uint64_t next_seq;                 // 下一个放入缓冲区的事件序号
+    int lost;                          // 需要先发送 WATCH_EVENT_LOST
+    uint64_t lost_seq;
+    int want_write;                    // 已注册 EPOLLOUT
+    int closed;                        // 对端已关闭
+    unsigned long pushed;
+    size_t head, tail;                 // 待发送数据为 buffer[head, tail)
+    char buffer[WATCH_BUFFER_SIZE];
+} subscriber;
+
+// 待删除保留期到期时间, 按 (到期时间, 路径) 排序的最小堆
+typedef struct {
+    time_t expires;
+    char *path;
+} retention_entry;
+
+typedef struct {
+    int fd;
+    struct timespec due;
+} pending_write;
+
+static uint64_t epoch;
+static char watch_dir[PATH_MAX];
+static int watch_epoll = -1;
+static int wake_fd = -1;
+static int fanotify_fd = -1;
+
+// 事件历史与订阅计数
+static pthread_mutex_t history_lock = PTHREAD_MUTEX_INITIALIZER;
+static history_entry history[WATCH_HISTORY_SIZE];
+static uint64_t last_seq = 0;
+static subscriber *pending_head = NULL;
+static size_t subscriber_total = 0;    // 含等待接管的订阅
+
+static atomic_int tracking = 0;
+
+static pthread_mutex_t retention_lock = PTHREAD_MUTEX_INITIALIZER;
+static retention_entry *heap = NULL;
+static size_t heap_count = 0;
+static size_t heap_allocated = 0;
+
+// 以下只由推送线程访问
+static subscriber *subscribers[WATCH_MAX_SUBSCRIBERS];
+static size_t subscriber_count = 0;
+static pending_write pending_writes[WATCH_FANOTIFY_PENDING];
+static size_t pending_write_count = 0;
+
+static void wake_pusher(void) {
+    uint64_t one = 1;
+    if (wake_fd != -1 && write(wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        log_message("ERROR", "无法唤醒事件推送线程: %s", strerror(errno));
+    }
+}
+
+void watch_publish(watch_event_type type, const char *relative_path) {
+    char *path = strdup(relative_path);
+    char *old;
+    int notify;
+
+    if (!path) return;
+
+    pthread_mutex_lock(&history_lock);
+    history_entry *h = &history[++last_seq % WATCH_HISTORY_SIZE];
+    old = h->path;
+    h->seq = last_seq;
+    h->time = time(NULL);
+    h->type = type;
+    h->path = path;
+    notify = subscriber_total > 0;
+    pthread_mutex_unlock(&history_lock);
+
+    free(old);
+    if (notify) wake_pusher();
+}
+
+static int entry_before(const retention_entry *a, const retention_entry *b) {
+    return a->expires < b->expires || (a->expires == b->expires && strcmp(a->path, b->path) < 0);
+}
+
+// 调用者持有 retention_lock
+static int heap_push(time_t expires, char *path) {
+    size_t i;
+
+    if (heap_count == heap_allocated) {
+        size_t allocated = heap_allocated ? heap_allocated * 2 : 1024;
+        retention_entry *grown = realloc(heap, allocated * sizeof(retention_entry));
+        if (!grown) return -1;
+        heap = grown;
+        heap_allocated = allocated;
+    }
+
+    i = heap_count++;
+    heap[i].expires = expires;
+    heap[i].path = path;
+    while (i > 0 && entry_before(&heap[i], &heap[(i - 1) / 2])) {
+        retention_entry tmp = heap[i];
+        heap[i] = heap[(i - 1) / 2];
+        heap[(i - 1) / 2] = tmp;
+        i = (i - 1) / 2;
+    }
+    return (int)i;
+}
+
+static retention_entry heap_pop(void) {
+    retention_entry top = heap[0];
+    size_t i = 0;
+
+    heap[0] = heap[--heap_count];
+    for (;;) {
+        size_t l = 2 * i + 1, r = l + 1, m = i;
+        if (l < heap_count && entry_before(&heap[l], &heap[m])) m = l;
+        if (r < heap_count && entry_before(&heap[r], &heap[m])) m = r;
+        if (m == i) break;
+        retention_entry tmp = heap[i];
+        heap[i] = heap[m];
+        heap[m] = tmp;
+        i = m;
+    }
+    return top;
+}
+
+static void track_until(const char *relative_path, time_t expires) {
+    char *path = strdup(relative_path);
+    int position;
+
+    if (!path) return;
+    pthread_mutex_lock(&retention_lock);
+    position = heap_push(expires, path);
+    pthread_mutex_unlock(&retention_lock);
+
+    if (position < 0) {
+        free(path);
+    } else if (position == 0) {
+        wake_pusher();   // 最早的到期时间变化, 重新计算等待时间
+    }
+}
+
+void watch_track_retention(const char *relative_path, time_t creation_time) {
+    time_t expires = creation_time + MIN_RETENTION_HOURS * 3600;
+
+    if (!atomic_load(&tracking) || expires <= time(NULL)) return;
+    track_until(relative_path, expires);
+}
+
+// 到期的对象发布事件; 重复跟踪的条目在堆中相邻, 只发布一次
+static void expire_retention(void) {
+    static char last_path[MAX_PATH_LEN];
+    static time_t last_expires = 0;
+    time_t now = time(NULL);
+
+    for (;;) {
+        retention_entry entry;
+        file_metadata metadata;
+
+        pthread_mutex_lock(&retention_lock);
+        if (heap_count == 0 || heap[0].expires > now) {
+            pthread_mutex_unlock(&retention_lock);
+            break;
+        }
+        entry = heap_pop();
+        pthread_mutex_unlock(&retention_lock);
+
+        if (entry.expires == last_expires && strcmp(entry.path, last_path) == 0) {
+            free(entry.path);
+            continue;
+        }
+
+        // 以当前元数据为准: 对象可能已被删除, 备用实例的创建时间来自主实例
+        if (object_index_lookup(entry.path, &metadata, NULL) == 0) {
+            time_t actual = metadata.creation_time + MIN_RETENTION_HOURS * 3600;
+            if (actual > now) {
+                track_until(entry.path, actual);
+                free(entry.path);
+                continue;
+            }
+            watch_publish(WATCH_EVENT_RETENTION_EXPIRED, entry.path);
+        }
+
+        last_expires = entry.expires;
+        snprintf(last_path, sizeof(last_path), "%s", entry.path);
+        free(entry.path);
+    }
+}
+
+static void sweep_object(const char *relative_path, unsigned flags, void *arg) {
+    file_metadata metadata;
+    size_t *tracked = arg;
+
+    (void)flags;
+    if (is_internal_file(relative_path)) return;
+    if (object_index_lookup(relative_path, &metadata, NULL) == 0 && !retention_expired(&metadata)) {
+        watch_track_retention(relative_path, metadata.creation_time);
+        (*tracked)++;
+    }
+}
+
+// 第一个订阅者出现时, 为已有的对象建立保留期跟踪 (之后新建的对象在创建时加入)
+static void *retention_sweep(void *arg) {
+    size_t tracked = 0;
+
+    (void)arg;
+    while (recovery_in_progress()) {
+        sleep(1);
+    }
+    for (size_t shard = 0; shard < INDEX_SHARDS; shard++) {
+        object_index_for_each(shard, sweep_object, &tracked);
+    }
+    log_message("INFO", "保留期跟踪已建立: %zu 个对象尚在保留期内", tracked);
+    return NULL;
+}
+
+// 在缓冲区末尾加入一个事件, 空间不足时返回0
+static int append_event(subscriber *sub, uint64_t seq, int64_t time, uint32_t type,
+                        const char *path, size_t path_len) {
+    watch_event ev;
+
+    if (WATCH_BUFFER_SIZE - sub->tail < sizeof(ev) + path_len) return 0;
+    ev.seq = seq;
+    ev.time = time;
+    ev.type = type;
+    ev.path_len = path_len;
+    memcpy(sub->buffer + sub->tail, &ev, sizeof(ev));
+    memcpy(sub->buffer + sub->tail + sizeof(ev), path, path_len);
+    sub->tail += sizeof(ev) + path_len;
+    sub->pushed++;
+    return 1;
+}
+
+// 从历史中取出订阅者尚未收到的事件放入缓冲区; 缓冲区放满时返回1
+static int fill_buffer(subscriber *sub) {
+    uint64_t first;
+    int more = 0;
+
+    if (sub->head > 0) {
+        memmove(sub->buffer, sub->buffer + sub->head, sub->tail - sub->head);
+        sub->tail -= sub->head;
+        sub->head = 0;
+    }
+
+    pthread_mutex_lock(&history_lock);
+
+    // 落后超过历史环长度: 中间的事件已被覆盖; 跳到较新的一半历史, 避免刚追上又被覆盖
+    first = last_seq >= WATCH_HISTORY_SIZE ? last_seq - WATCH_HISTORY_SIZE + 1 : 1;
+    if (sub->next_seq < first) {
+        sub->next_seq = last_seq - WATCH_HISTORY_SIZE / 2 + 1;
+        sub->lost = 1;
+        sub->lost_seq = sub->next_seq - 1;
+    }
+
+    if (sub->lost) {
+        if (!append_event(sub, sub->lost_seq, time(NULL), WATCH_EVENT_LOST, "", 0)) {
+            more = 1;
+            goto out;
+        }
+        sub->lost = 0;
+    }
+
+    for (; sub->next_seq <= last_seq; sub->next_seq++) {
+        const history_entry *h = &history[sub->next_seq % WATCH_HISTORY_SIZE];
+        if (h->seq != sub->next_seq || strncmp(h->path, sub->prefix, sub->prefix_len) != 0) continue;
+        if (!append_event(sub, h->seq, h->time, h->type, h->path, strlen(h->path))) {
+            more = 1;
+            break;
+        }
+    }
+
+out:
+    pthread_mutex_unlock(&history_lock);
+    return more;
+}
+
+// 非阻塞发送缓冲区; 发不完时等待 EPOLLOUT
+static int flush_buffer(subscriber *sub) {
+    struct epoll_event ev;
+    int want_write;
+
+    while (sub->head < sub->tail) {
+        ssize_t n = send(sub->session->fd, sub->buffer + sub->head, sub->tail - sub->head,
+                         MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0) {
+            sub->head += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            return -1;
+        }
+    }
+    if (sub->head == sub->tail) {
+        sub->head = sub->tail = 0;
+    }
+
+    want_write = sub->head < sub->tail;
+    if (want_write != sub->want_write) {
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLRDHUP | (want_write ? EPOLLOUT : 0);
+        ev.data.ptr = sub;
+        if (epoll_ctl(watch_epoll, EPOLL_CTL_MOD, sub->session->fd, &ev) != 0) return -1;
+        sub->want_write = want_write;
+    }
+    return 0;
+}
+
+static int pump(subscriber *sub) {
+    int more;
+
+    do {
+        more = fill_buffer(sub);
+        if (flush_buffer(sub) != 0) return -1;
+    } while (more && sub->head == sub->tail);
+    return 0;
+}
+
+static void drop_subscriber(size_t i) {
+    subscriber *sub = subscribers[i];
+
+    epoll_ctl(watch_epoll, EPOLL_CTL_DEL, sub->session->fd, NULL);
+    log_message("INFO", "订阅结束: uid %d, 前缀 \"%s\", 推送 %lu 个事件",
+               (int)sub->session->uid, sub->prefix, sub->pushed);
+    session_close(sub->session);
+    free(sub);
+    subscribers[i] = subscribers[--subscriber_count];
+
+    pthread_mutex_lock(&history_lock);
+    subscriber_total--;
+    pthread_mutex_unlock(&history_lock);
+}
+
+// 订阅者在推送开始后不再发送数据, 可读表示对端关闭 (多余的数据丢弃)
+static int peer_closed(subscriber *sub) {
+    char discard[256];
+    ssize_t n = recv(sub->session->fd, discard, sizeof(discard), MSG_DONTWAIT);
+    return n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR);
+}
+
+static void adopt_pending(void) {
+    subscriber *list;
+
+    pthread_mutex_lock(&history_lock);
+    list = pending_head;
+    pending_head = NULL;
+    pthread_mutex_unlock(&history_lock);
+
+    while (list) {
+        subscriber *sub = list;
+        struct epoll_event ev;
+
+        list = sub->next;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.ptr = sub;
+        subscribers[subscriber_count++] = sub;
+        if (epoll_ctl(watch_epoll, EPOLL_CTL_ADD, sub->session->fd, &ev) != 0) {
+            log_message("ERROR", "无法监听订阅连接: %s", strerror(errno));
+            drop_subscriber(subscriber_count - 1);
+        }
+    }
+}
+
+static long ms_until(const struct timespec *due) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (due->tv_sec - now.tv_sec) * 1000L + (due->tv_nsec - now.tv_nsec) / 1000000L;
+}
+
+// 读取 fanotify 事件; 服务自身进程的写入直接忽略, 其余延迟核对
+static void read_fanotify(void) {
+    char buffer[8192] __attribute__((aligned(__alignof__(struct fanotify_event_metadata))));
+    ssize_t len;
+
+    while ((len = read(fanotify_fd, buffer, sizeof(buffer))) > 0) {
+        struct fanotify_event_metadata *m = (struct fanotify_event_metadata *)buffer;
+        for (; FAN_EVENT_OK(m, len); m = FAN_EVENT_NEXT(m, len)) {
+            if (m->mask & FAN_Q_OVERFLOW) {
+                log_message("WARNING", "fanotify 事件队列溢出, 部分带外写入未被报告");
+                continue;
+            }
+            if (m->fd < 0) continue;
+            if (m->pid == getpid() || pending_write_count == WATCH_FANOTIFY_PENDING) {
+                close(m->fd);
+                continue;
+            }
+            pending_write *p = &pending_writes[pending_write_count++];
+            p->fd = m->fd;
+            clock_gettime(CLOCK_MONOTONIC, &p->due);
+            p->due.tv_sec += WATCH_FANOTIFY_DELAY_MS / 1000;
+            p->due.tv_nsec += (WATCH_FANOTIFY_DELAY_MS % 1000) * 1000000L;
+            if (p->due.tv_nsec >= 1000000000L) {
+                p->due.tv_sec++;
+                p->due.tv_nsec -= 1000000000L;
+            }
+        }
+    }
+}
+
+static int has_suffix(const char *name, const char *suffix) {
+    size_t len = strlen(name), slen = strlen(suffix);
+    return len > slen && strcmp(name + len - slen, suffix) == 0;
+}
+
+// 核对一个被其他进程写入的文件: 修改时间晚于 .meta 中的记录即为带外写入
+// (服务调用的 rsync 在更新元数据前关闭文件, 因此延迟到元数据落盘后再核对)
+static void check_external_write(int fd) {
+    char link[64], target[PATH_MAX];
+    size_t dir_len = strlen(watch_dir);
+    file_metadata metadata;
+    struct stat st;
+    ssize_t n;
+
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+    n = readlink(link, target, sizeof(target) - 1);
+    if (n <= 0 || fstat(fd, &st) != 0 || st.st_nlink == 0) return;
+    target[n] = '\0';
+    if (strncmp(target, watch_dir, dir_len) != 0 || target[dir_len] != '/') return;
+
+    const char *relative_path = target + dir_len + 1;
+    if (is_internal_file(relative_path) || has_suffix(relative_path, ".meta") ||
+        has_suffix(relative_path, ".merkle") || has_suffix(relative_path, ".source")) {
+        return;
+    }
+
+    // 持有路径锁读取, 不会把服务自身正在写入的 .meta 误判为缺失
+    pthread_mutex_t *lock = path_lock_of(relative_path);
+    pthread_mutex_lock(lock);
+    int known = load_metadata(target, &metadata) == 0 && st.st_mtime <= metadata.modification_time;
+    pthread_mutex_unlock(lock);
+    if (known) return;
+
+    log_message("WARNING", "检测到绕过服务的写入: %s", relative_path);
+    watch_publish(WATCH_EVENT_EXTERNAL_WRITE, relative_path);
+}
+
+static void check_pending_writes(void) {
+    size_t done = 0;
+
+    while (done < pending_write_count && ms_until(&pending_writes[done].due) <= 0) {
+        check_external_write(pending_writes[done].fd);
+        close(pending_writes[done].fd);
+        done++;
+    }
+    memmove(pending_writes, pending_writes + done, (pending_write_count - done) * sizeof(pending_write));
+    pending_write_count -= done;
+}
+
+// 距离下一次保留期到期或带外写入核对的毫秒数, 没有时返回-1
+static int next_timeout(void) {
+    long timeout = -1;
+
+    pthread_mutex_lock(&retention_lock);
+    if (heap_count > 0) {
+        time_t wait = heap[0].expires - time(NULL);
+        timeout = wait > 0 ? (wait > 3600 ? 3600 : wait) * 1000L : 0;
+    }
+    pthread_mutex_unlock(&retention_lock);
+
+    if (pending_write_count > 0) {
+        long wait = ms_until(&pending_writes[0].due);
+        if (wait < 0) wait = 0;
+        if (timeout < 0 || wait < timeout) timeout = wait;
+    }
+    return (int)timeout;
+}
+
+static void *watch_thread(void *arg) {
+    struct epoll_event events[64];
+
+    (void)arg;
+    for (;;) {
+        int n = epoll_wait(watch_epoll, events, 64, next_timeout());
+        if (n < 0 && errno != EINTR) {
+            log_message("ERROR", "事件推送线程等待失败: %s", strerror(errno));
+            sleep(1);
+            continue;
+        }
+
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == &wake_fd) {
+                uint64_t count;
+                if (read(wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+                    log_message("ERROR", "读取唤醒计数失败: %s", strerror(errno));
+                }
+                adopt_pending();
+            } else if (events[i].data.ptr == &fanotify_fd) {
+                read_fanotify();
+            }
+        }
+
+        expire_retention();
+        check_pending_writes();
+
+        // 对端已关闭的订阅者在这里移除, 其余的补充并发送缓冲区
+        for (int i = 0; i < n; i++) {
+            subscriber *sub = events[i].data.ptr;
+            if (sub == (void *)&wake_fd || sub == (void *)&fanotify_fd) continue;
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                if (peer_closed(sub)) sub->closed = 1;
+            }
+        }
+        for (size_t i = 0; i < subscriber_count; ) {
+            if (subscribers[i]->closed || pump(subscribers[i]) != 0) {
+                drop_subscriber(i);
+            } else {
+                i++;
+            }
+        }
+    }
+    return NULL;
+}
+
+int watch_subscribe(session *s, const char *prefix, const watch_request *wr) {
+    size_t prefix_len = strnlen(prefix, MAX_PATH_LEN);
+    const char *reject = NULL;
+    int status = 0;
+    response_header resp;
+    watch_ack ack;
+    subscriber *sub;
+    pthread_t tid;
+    int first = 0;
+    int flags;
+
+    if (watch_epoll == -1 || prefix_len >= MAX_PATH_LEN) return -1;
+
+    sub = calloc(1, sizeof(subscriber));
+    if (!sub) return -1;
+    sub->session = s;
+    memcpy(sub->prefix, prefix, prefix_len + 1);
+    sub->prefix_len = prefix_len;
+
+    pthread_mutex_lock(&history_lock);
+    if (subscriber_total >= WATCH_MAX_SUBSCRIBERS) {
+        reject = "订阅者过多";
+        status = WATCH_REJECT_BUSY;
+    } else if (wr->epoch != 0 && wr->epoch != epoch) {
+        // 服务已重启, 旧纪元的序号无效, 从当前开始并提示重新同步
+        sub->next_seq = last_seq + 1;
+        sub->lost = 1;
+        sub->lost_seq = last_seq;
+    } else if (wr->epoch == 0) {
+        sub->next_seq = last_seq + 1;
+    } else if (wr->since_seq > last_seq) {
+        reject = "无效的事件序号";
+        status = WATCH_REJECT_INVALID_SEQ;
+    } else {
+        sub->next_seq = wr->since_seq + 1;   // 已被覆盖时由 fill_buffer 发送 WATCH_EVENT_LOST
+    }
+    if (reject) {
+        pthread_mutex_unlock(&history_lock);
+        log_message("WARNING", "拒绝订阅 (uid %d): %s", (int)s->uid, reject);
+        free(sub);
+        return status;
+    }
+
+    // 订阅应答作为缓冲区中的第一段数据, 保证先于任何事件到达
+    resp.status = 0;
+    resp.length = sizeof(ack);
+    ack.epoch = epoch;
+    ack.next_seq = sub->next_seq;
+    memcpy(sub->buffer, &resp, sizeof(resp));
+    memcpy(sub->buffer + sizeof(resp), &ack, sizeof(ack));
+    sub->tail = sizeof(resp) + sizeof(ack);
+
+    flags = fcntl(s->fd, F_GETFL);
+    fcntl(s->fd, F_SETFL, flags | O_NONBLOCK);
+
+    sub->next = pending_head;
+    pending_head = sub;
+    subscriber_total++;
+    if (!atomic_load(&tracking)) {
+        atomic_store(&tracking, 1);
+        first = 1;
+    }
+    pthread_mutex_unlock(&history_lock);
+
+    log_message("INFO", "建立订阅: uid %d, pid %d, 前缀 \"%s\", 从序号 %llu 开始",
+               (int)s->uid, (int)s->pid, prefix, (unsigned long long)ack.next_seq);
+
+    if (first) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&tid, &attr, retention_sweep, NULL) != 0) {
+            log_message("ERROR", "无法创建保留期跟踪线程: %s", strerror(errno));
+        }
+        pthread_attr_destroy(&attr);
+    }
+
+    wake_pusher();
+    return 0;
+}
+
+static int start_fanotify(const char *dir) {
+    struct epoll_event ev;
+
+    fanotify_fd = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK, O_RDONLY | O_LARGEFILE | O_CLOEXEC);
+    if (fanotify_fd == -1) {
+        log_message("WARNING", "无法启用 fanotify: %s", strerror(errno));
+        return -1;
+    }
+    // 只监视数据目录下的文件 (不含子目录)
+    if (fanotify_mark(fanotify_fd, FAN_MARK_ADD, FAN_CLOSE_WRITE | FAN_EVENT_ON_CHILD, AT_FDCWD, dir) != 0) {
+        log_message("WARNING", "无法监视数据目录 %s: %s", dir, strerror(errno));
+        close(fanotify_fd);
+        fanotify_fd = -1;
+        return -1;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = &fanotify_fd;
+    if (epoll_ctl(watch_epoll, EPOLL_CTL_ADD, fanotify_fd, &ev) != 0) {
+        close(fanotify_fd);
+        fanotify_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+int watch_start(const char *dir, int use_fanotify) {
+    struct epoll_event ev;
+    pthread_t tid;
+
+    // 每次启动使用新的纪元, 客户端据此判断序号是否仍然有效
+    if (getrandom(&epoch, sizeof(epoch), 0) != sizeof(epoch)) {
+        epoch = ((uint64_t)time(NULL) << 20) ^ (uint64_t)getpid();
+    }
+    if (epoch == 0) epoch = 1;
+
+    if (!realpath(dir, watch_dir)) {
+        snprintf(watch_dir, sizeof(watch_dir), "%s", dir);
+    }
+
+    watch_epoll = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (watch_epoll == -1 || wake_fd == -1) {
+        log_message("ERROR", "无法初始化事件推送: %s", strerror(errno));
+        return -1;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = &wake_fd;
+    epoll_ctl(watch_epoll, EPOLL_CTL_ADD, wake_fd, &ev);
+
+    if (use_fanotify) {
+        start_fanotify(watch_dir);
+    }
+
+    if (pthread_create(&tid, NULL, watch_thread, NULL) != 0) {
+        log_message("ERROR", "无法创建事件推送线程: %s", strerror(errno));
+        close(watch_epoll);
+        watch_epoll = -1;
+        return -1;
+    }
+    pthread_detach(tid);
+
+    log_message("INFO", "事件推送已启动: 纪元 %016llx, fanotify %s", (unsigned long long)epoch,
+               fanotify_fd != -1 ? "已启用" : "未启用");
+    return 0;
+}
+
+int watch_status(char *buffer, size_t buffer_size) {
+    size_t subscribers_now, tracked;
+    uint64_t seq;
+
+    pthread_mutex_lock(&history_lock);
+    seq = last_seq;
+    subscribers_now = subscriber_total;
+    pthread_mutex_unlock(&history_lock);
+
+    pthread_mutex_lock(&retention_lock);
+    tracked = heap_count;
+    pthread_mutex_unlock(&retention_lock);
+
+    snprintf(buffer, buffer_size, "事件: 纪元 %016llx, 序号 %llu, 订阅者 %zu, 跟踪保留期 %zu 个对象, fanotify %s\n",
+             (unsigned long long)epoch, (unsigned long long)seq, subscribers_now, tracked,
+             fanotify_fd != -1 ? "已启用" : "未启用");
+    return 0;
+}
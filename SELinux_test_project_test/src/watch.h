@@ -0,0 +1,53 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stddef.h>
+#include <time.h>
+
+#include "immutable_service.h"
+
+#define WATCH_HISTORY_SIZE 8192              // 保留的最近事件数, 断线后可从中按序号续订
+#define WATCH_BUFFER_SIZE (64 * 1024)        // 每个订阅者的发送缓冲区
+#define WATCH_MAX_SUBSCRIBERS 256
+#define WATCH_FANOTIFY_PENDING 256           // 等待核对的带外写入事件上限
+#define WATCH_FANOTIFY_DELAY_MS 1000         // 带外写入延迟核对, 等待服务自身的元数据更新落盘
+
+struct session;
+
+/**
+ * 启动事件推送线程; 之前发布的事件 (例如重做日志) 同样保留在历史中
+ *
+ * @param dir 数据目录
+ * @param use_fanotify 非0时用 fanotify 监视数据目录中绕过服务的写入 (需要 CAP_SYS_ADMIN)
+ * @return 成功返回0，失败返回-1
+ */
+int watch_start(const char *dir, int use_fanotify);
+
+/**
+ * 发布一个事件: 分配序号并写入历史环, 由推送线程按各订阅者的前缀过滤后发送
+ * 开销与订阅者数量无关, 可在变更路径上直接调用
+ */
+void watch_publish(watch_event_type type, const char *relative_path);
+
+/**
+ * 跟踪新建对象的保留期, 到期时发布 WATCH_EVENT_RETENTION_EXPIRED
+ * 第一个订阅者出现之前不跟踪 (此前没有客户端持有当前纪元的序号)
+ */
+void watch_track_retention(const char *relative_path, time_t creation_time);
+
+/**
+ * 为连接建立订阅, 成功后连接 (及会话) 交由推送线程管理, 由其发送 watch_ack 和后续事件
+ * 调用者须先将连接从请求的 epoll 中移除
+ *
+ * @param prefix 路径前缀, 空字符串表示全部
+ * @return 成功返回0，被拒绝返回 WATCH_REJECT_BUSY 或 WATCH_REJECT_INVALID_SEQ，
+ *         其他失败返回-1 (连接仍归调用者)
+ */
+int watch_subscribe(struct session *s, const char *prefix, const watch_request *wr);
+
+/**
+ * 输出事件序号与订阅者数量
+ */
+int watch_status(char *buffer, size_t buffer_size);
+
+#endif /* WATCH_H */